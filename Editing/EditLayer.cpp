@@ -0,0 +1,372 @@
+#include "EditLayer.h"
+#include "../TerrainGenerator/HeightCodec.h"
+#include "../Parallel/ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+
+// Dirty rectangles kept before the closest pair is merged.
+const size_t MAX_DIRTY_RECTS = 8;
+// Brush rows handled per task.
+const int BRUSH_GRAIN = 16;
+
+static int floorDiv(int a, int b)
+{
+	return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+static int ceilDiv(int a, int b)
+{
+	return floorDiv(a + b - 1, b);
+}
+
+static long long area(const DirtyRect &rect)
+{
+	return (long long)(rect.x1 - rect.x0) * (rect.y1 - rect.y0);
+}
+
+static DirtyRect unite(const DirtyRect &a, const DirtyRect &b)
+{
+	return DirtyRect(std::min(a.x0, b.x0), std::min(a.y0, b.y0), std::max(a.x1, b.x1), std::max(a.y1, b.y1));
+}
+
+EditLayer::EditLayer(int tileSize, float maxError)
+	: tileSize(std::max(tileSize, 1)), maxError(maxError), deltaPool((size_t)this->tileSize * this->tileSize)
+{
+}
+
+EditLayer::Tile &EditLayer::unpackTile(const ChunkKey &key)
+{
+	Tile &tile = tiles[key];
+	if(tile.deltas.empty())
+	{
+		// Recycled from earlier strokes, so it still holds their deltas.
+		tile.deltas = deltaPool.acquire();
+		if(tile.packed.empty() || !decodeHeights(tile.packed.data(), tile.packed.size(), tile.deltas.data(), tileSize))
+			std::fill(tile.deltas.begin(), tile.deltas.end(), 0.0f);
+		tile.packed.clear();
+		tile.packed.shrink_to_fit();
+		hotTiles.push_back(key);
+	}
+	return tile;
+}
+
+const float *EditLayer::tileDeltas(const Tile &tile, std::vector<float> &scratch) const
+{
+	if(!tile.deltas.empty())
+		return tile.deltas.data();
+	scratch.resize((size_t)tileSize * tileSize);
+	if(!decodeHeights(tile.packed.data(), tile.packed.size(), scratch.data(), tileSize))
+		std::fill(scratch.begin(), scratch.end(), 0.0f);
+	return scratch.data();
+}
+
+void EditLayer::markDirty(DirtyRect rect)
+{
+	bool merged = true;
+	while(merged)
+	{
+		merged = false;
+		for(size_t i = 0; i < dirty.size(); i++)
+		{
+			const DirtyRect &other = dirty[i];
+			if(other.x0 <= rect.x1 && rect.x0 <= other.x1 && other.y0 <= rect.y1 && rect.y0 <= other.y1)
+			{
+				rect = unite(rect, other);
+				dirty.erase(dirty.begin() + i);
+				merged = true;
+				break;
+			}
+		}
+	}
+	if(dirty.size() >= MAX_DIRTY_RECTS)
+	{
+		// Merge with whichever rectangle grows the least, which may overlap others again.
+		size_t best = 0;
+		long long bestGrowth = -1;
+		for(size_t i = 0; i < dirty.size(); i++)
+		{
+			long long growth = area(unite(rect, dirty[i])) - area(dirty[i]);
+			if(bestGrowth < 0 || growth < bestGrowth)
+			{
+				best = i;
+				bestGrowth = growth;
+			}
+		}
+		rect = unite(rect, dirty[best]);
+		dirty.erase(dirty.begin() + best);
+		markDirty(rect);
+		return;
+	}
+	dirty.push_back(rect);
+}
+
+void EditLayer::applyBrush(const TerrainBrush &brush, HeightMap *map, int mapX, int mapY)
+{
+	const float radius = brush.radius;
+	if(!(radius > 0.0f))
+		return;
+	int x0 = (int)std::floor(brush.x - radius), x1 = (int)std::floor(brush.x + radius) + 1;
+	int y0 = (int)std::floor(brush.y - radius), y1 = (int)std::floor(brush.y + radius) + 1;
+	if(map)
+	{
+		// The map is updated in place, so samples it does not hold must not be
+		// edited either or they would be missing from it until regenerated.
+		x0 = std::max(x0, mapX);
+		y0 = std::max(y0, mapY);
+		x1 = std::min(x1, mapX + map->width);
+		y1 = std::min(y1, mapY + map->height);
+	}
+	else if(brush.mode != BRUSH_RAISE)
+	{
+		return;
+	}
+	if(x0 >= x1 || y0 >= y1)
+		return;
+
+	// Unpack every tile the brush circle reaches, leaving the others null.
+	int tx0 = floorDiv(x0, tileSize), ty0 = floorDiv(y0, tileSize);
+	int tilesX = floorDiv(x1 - 1, tileSize) - tx0 + 1, tilesY = floorDiv(y1 - 1, tileSize) - ty0 + 1;
+	std::vector<float *> brushTiles((size_t)tilesX * tilesY, nullptr);
+	for(int ty = 0; ty < tilesY; ty++)
+	{
+		for(int tx = 0; tx < tilesX; tx++)
+		{
+			float left = (float)((tx0 + tx) * tileSize), top = (float)((ty0 + ty) * tileSize);
+			float dx = brush.x - std::min(std::max(brush.x, left), left + tileSize - 1);
+			float dy = brush.y - std::min(std::max(brush.y, top), top + tileSize - 1);
+			if(dx * dx + dy * dy < radius * radius)
+				brushTiles[(size_t)ty * tilesX + tx] = unpackTile(ChunkKey(tx0 + tx, ty0 + ty)).deltas.data();
+		}
+	}
+
+	const float r2 = radius * radius;
+	auto weightAt = [&](int x, int y) {
+		float dx = x - brush.x, dy = y - brush.y;
+		float falloff = 1.0f - (dx * dx + dy * dy) / r2;
+		return falloff > 0.0f ? falloff * falloff : 0.0f;
+	};
+	auto heightAt = [&](int x, int y) {
+		x = std::min(std::max(x - mapX, 0), map->width - 1);
+		y = std::min(std::max(y - mapY, 0), map->height - 1);
+		return map->at(x, y);
+	};
+
+	// Smooth reads neighbours, so every change is computed before any is applied.
+	const int width = x1 - x0;
+	std::vector<float> changes((size_t)width * (y1 - y0), 0.0f);
+	ThreadPool::global().parallelFor(y1 - y0, BRUSH_GRAIN, [&](int first, int last) {
+		for(int row = first; row < last; row++)
+		{
+			int y = y0 + row;
+			float *change = &changes[(size_t)row * width];
+			for(int x = x0; x < x1; x++)
+			{
+				float weight = weightAt(x, y);
+				if(weight <= 0.0f)
+					continue;
+				if(brush.mode == BRUSH_RAISE)
+				{
+					change[x - x0] = brush.strength * weight;
+					continue;
+				}
+				float blend = std::min(brush.strength * weight, 1.0f);
+				float height = heightAt(x, y);
+				float goal = brush.target;
+				if(brush.mode == BRUSH_SMOOTH)
+					goal = 0.25f * (heightAt(x - 1, y) + heightAt(x + 1, y) + heightAt(x, y - 1) + heightAt(x, y + 1));
+				change[x - x0] = (goal - height) * blend;
+			}
+		}
+	});
+	ThreadPool::global().parallelFor(y1 - y0, BRUSH_GRAIN, [&](int first, int last) {
+		for(int row = first; row < last; row++)
+		{
+			int y = y0 + row;
+			int ty = floorDiv(y, tileSize);
+			int localY = y - ty * tileSize;
+			const float *change = &changes[(size_t)row * width];
+			float *mapRow = map ? map->row(y - mapY) - mapX : nullptr;
+			for(int tx = 0; tx < tilesX; tx++)
+			{
+				float *deltas = brushTiles[(size_t)(ty - ty0) * tilesX + tx];
+				if(!deltas)
+					continue;
+				int left = (tx0 + tx) * tileSize;
+				int spanStart = std::max(x0, left), spanEnd = std::min(x1, left + tileSize);
+				float *deltaRow = deltas + (size_t)localY * tileSize - left;
+				for(int x = spanStart; x < spanEnd; x++)
+				{
+					float delta = std::min(std::max(deltaRow[x] + change[x - x0], -brush.maxDelta), brush.maxDelta);
+					if(mapRow)
+						mapRow[x] += delta - deltaRow[x];
+					deltaRow[x] = delta;
+				}
+			}
+		}
+	});
+	markDirty(DirtyRect(x0, y0, x1, y1));
+}
+
+void EditLayer::endStroke()
+{
+	std::vector<char> empty(hotTiles.size(), 0);
+	ThreadPool::global().parallelFor(hotTiles.size(), 1, [&](int first, int last) {
+		for(int i = first; i < last; i++)
+		{
+			Tile &tile = tiles.find(hotTiles[i])->second;
+			if(std::all_of(tile.deltas.begin(), tile.deltas.end(), [](float d) { return d == 0.0f; }))
+				empty[i] = 1;
+			else
+				tile.packed = encodeHeights(tile.deltas.data(), tileSize, tileSize, tileSize, maxError);
+			deltaPool.release(std::move(tile.deltas));
+			tile.deltas.clear();
+		}
+	});
+	for(size_t i = 0; i < hotTiles.size(); i++)
+	{
+		const ChunkKey &key = hotTiles[i];
+		if(empty[i])
+			tiles.erase(key);
+		// Lossy packing moves any sample of the tile within maxError, not only the stroke's.
+		else if(maxError > 0.0f)
+			markDirty(DirtyRect(key.x * tileSize, key.y * tileSize, (key.x + 1) * tileSize, (key.y + 1) * tileSize));
+	}
+	hotTiles.clear();
+}
+
+void EditLayer::composite(int x, int y, int width, int height, float *out, int stride, int step) const
+{
+	if(tiles.empty() || width <= 0 || height <= 0)
+		return;
+	int tx0 = floorDiv(x, tileSize), tx1 = floorDiv(x + (width - 1) * step, tileSize);
+	int ty0 = floorDiv(y, tileSize), ty1 = floorDiv(y + (height - 1) * step, tileSize);
+	static thread_local std::vector<float> scratch;
+	for(int ty = ty0; ty <= ty1; ty++)
+	{
+		int top = ty * tileSize;
+		int rowStart = std::max(0, ceilDiv(top - y, step)), rowEnd = std::min(height, ceilDiv(top + tileSize - y, step));
+		for(int tx = tx0; tx <= tx1; tx++)
+		{
+			auto found = tiles.find(ChunkKey(tx, ty));
+			if(found == tiles.end())
+				continue;
+			const float *deltas = tileDeltas(found->second, scratch);
+			int left = tx * tileSize;
+			int columnStart = std::max(0, ceilDiv(left - x, step)), columnEnd = std::min(width, ceilDiv(left + tileSize - x, step));
+			for(int row = rowStart; row < rowEnd; row++)
+			{
+				const float *deltaRow = deltas + (size_t)(y + row * step - top) * tileSize + (x - left);
+				float *outRow = out + (size_t)row * stride;
+				for(int column = columnStart; column < columnEnd; column++)
+				{
+					outRow[column] += deltaRow[column * step];
+				}
+			}
+		}
+	}
+}
+
+void EditLayer::composite(HeightMap &map, int x, int y, int step) const
+{
+	composite(x, y, map.width, map.height, map.heights.data(), map.width, step);
+}
+
+float EditLayer::delta(int x, int y) const
+{
+	float value = 0.0f;
+	composite(x, y, 1, 1, &value, 1);
+	return value;
+}
+
+bool EditLayer::hasEdits(const DirtyRect &rect) const
+{
+	if(rect.empty())
+		return false;
+	int tx0 = floorDiv(rect.x0, tileSize), tx1 = floorDiv(rect.x1 - 1, tileSize);
+	int ty0 = floorDiv(rect.y0, tileSize), ty1 = floorDiv(rect.y1 - 1, tileSize);
+	if((long long)(tx1 - tx0 + 1) * (ty1 - ty0 + 1) > (long long)tiles.size())
+	{
+		for(const auto &entry : tiles)
+		{
+			const ChunkKey &key = entry.first;
+			if(key.x >= tx0 && key.x <= tx1 && key.y >= ty0 && key.y <= ty1)
+				return true;
+		}
+		return false;
+	}
+	for(int ty = ty0; ty <= ty1; ty++)
+	{
+		for(int tx = tx0; tx <= tx1; tx++)
+		{
+			if(tiles.count(ChunkKey(tx, ty)))
+				return true;
+		}
+	}
+	return false;
+}
+
+std::vector<DirtyRect> EditLayer::takeDirty()
+{
+	std::vector<DirtyRect> result;
+	result.swap(dirty);
+	return result;
+}
+
+size_t EditLayer::memoryUsage() const
+{
+	size_t bytes = 0;
+	for(const auto &entry : tiles)
+	{
+		bytes += entry.second.deltas.capacity() * sizeof(float) + entry.second.packed.capacity();
+	}
+	return bytes + deltaPool.stats().free * deltaPool.elementsPerChunk() * sizeof(float);
+}
+
+DirtyRect refreshNormals(TerrainGenerator &generator, const EditLayer &edits, const HeightMap &map, int mapX, int mapY,
+	const DirtyRect &rect, NormalMap &normals, float cellSize, float heightScale)
+{
+	// Normals one sample around a changed height change with it.
+	DirtyRect local(std::max(rect.x0 - mapX - 1, 0), std::max(rect.y0 - mapY - 1, 0),
+		std::min(rect.x1 - mapX + 1, map.width), std::min(rect.y1 - mapY + 1, map.height));
+	if(local.empty())
+		return local;
+
+	// Copy the window with a one sample halo, generating whatever lies outside the map.
+	const int width = local.x1 - local.x0, height = local.y1 - local.y0;
+	const int stride = width + 2;
+	std::vector<float> window((size_t)stride * (height + 2));
+	auto generate = [&](int x, int y, int count, float *out) {
+		generator.GenerateHeights(mapX + x, mapY + y, count, 1, out, count);
+		edits.composite(mapX + x, mapY + y, count, 1, out, count);
+	};
+	for(int r = 0; r < height + 2; r++)
+	{
+		int y = local.y0 - 1 + r;
+		float *row = &window[(size_t)r * stride];
+		if(y < 0 || y >= map.height)
+		{
+			generate(local.x0 - 1, y, stride, row);
+			continue;
+		}
+		const float *source = map.row(y);
+		std::copy(source + local.x0, source + local.x1, row + 1);
+		if(local.x0 > 0)
+			row[0] = source[local.x0 - 1];
+		else
+			generate(-1, y, 1, row);
+		if(local.x1 < map.width)
+			row[stride - 1] = source[local.x1];
+		else
+			generate(map.width, y, 1, row + stride - 1);
+	}
+
+	ThreadPool::global().parallelFor(height, BRUSH_GRAIN, [&](int first, int last) {
+		for(int r = first; r < last; r++)
+		{
+			const float *mid = &window[(size_t)(r + 1) * stride + 1];
+			size_t i = (size_t)(local.y0 + r) * map.width + local.x0;
+			computeNormalSpan(mid - stride, mid, mid + stride, width, cellSize, heightScale, &normals.normals[i], &normals.slopes[i]);
+		}
+	});
+	return local;
+}
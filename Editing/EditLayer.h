@@ -0,0 +1,115 @@
+#ifndef EDITLAYER_H
+#define EDITLAYER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+#include "../TerrainGenerator/TerrainGenerator.h"
+#include "../TerrainGenerator/HeightMap.h"
+#include "../TerrainGenerator/NormalMap.h"
+#include "../TerrainGenerator/ChunkKey.h"
+#include "../Memory/ChunkPool.h"
+
+// Half open rectangle [x0, x1) x [y0, y1) in world samples.
+struct DirtyRect
+{
+	int x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+
+	DirtyRect() {}
+	DirtyRect(int x0, int y0, int x1, int y1) : x0(x0), y0(y0), x1(x1), y1(y1) {}
+	bool empty() const { return x0 >= x1 || y0 >= y1; }
+};
+
+enum BrushMode
+{
+	BRUSH_RAISE = 0,	// adds strength, negative strength lowers
+	BRUSH_SMOOTH = 1,	// pulls samples towards the average of their neighbours
+	BRUSH_FLATTEN = 2	// pulls samples towards `target`
+};
+
+struct TerrainBrush
+{
+	BrushMode mode = BRUSH_RAISE;
+	// Centre and radius in world samples.
+	float x = 0.0f, y = 0.0f, radius = 8.0f;
+	// Height added at the centre per dab for BRUSH_RAISE, blend factor for the others.
+	float strength = 0.01f;
+	float target = 0.0f;
+	// Deltas are kept within [-maxDelta, maxDelta], so edited heights stay in a
+	// known range around the generated ones.
+	float maxDelta = std::numeric_limits<float>::infinity();
+};
+
+// Sparse height deltas composited over the procedural terrain.
+// Deltas live in square tiles that only exist where something was edited.
+// Tiles touched by the current stroke stay as plain floats, endStroke packs
+// them with the height codec. Every change is recorded as a dirty rectangle
+// so callers rebuild only the affected samples, normals and buffer ranges.
+// Not safe to brush while another thread composites.
+class EditLayer
+{
+public:
+	// `maxError` is the codec bound used when packing, 0 keeps deltas exact
+	// at about four times the size. The bound applies again every time a
+	// stroke repacks a tile.
+	EditLayer(int tileSize = 64, float maxError = 1e-5f);
+
+	// Applies one dab. When `map` is given it must hold the composited
+	// heights of the window starting at world sample (mapX, mapY). The change
+	// is written into it as well, and smooth and flatten read it; those two
+	// modes only affect samples inside the map.
+	void applyBrush(const TerrainBrush &brush, HeightMap *map = nullptr, int mapX = 0, int mapY = 0);
+	// Packs the tiles touched since the last call and drops empty ones. With a
+	// nonzero bound packing may move any sample of a tile, so each packed tile
+	// is marked dirty as a whole.
+	void endStroke();
+
+	// Adds the deltas to a window of freshly generated heights whose first
+	// sample is world sample (x, y), samples `step` world samples apart.
+	void composite(int x, int y, int width, int height, float *out, int stride, int step = 1) const;
+	void composite(HeightMap &map, int x, int y, int step = 1) const;
+	float delta(int x, int y) const;
+	bool hasEdits(const DirtyRect &rect) const;
+
+	// Rectangles changed since the last call. Overlapping or touching
+	// rectangles are merged and the list is kept short.
+	std::vector<DirtyRect> takeDirty();
+
+	int getTileSize() const { return tileSize; }
+	size_t tileCount() const { return tiles.size(); }
+	// Bytes held by tile data, packed and unpacked, and by pooled buffers.
+	size_t memoryUsage() const;
+	// Unpacked tiles come from a pool, strokes after the first few allocate nothing.
+	ChunkPoolStats poolStats() const { return deltaPool.stats(); }
+
+private:
+	struct Tile
+	{
+		// Unpacked deltas while the tile is part of a stroke, empty otherwise.
+		std::vector<float> deltas;
+		std::vector<uint8_t> packed;
+	};
+
+	int tileSize;
+	float maxError;
+	std::unordered_map<ChunkKey, Tile, ChunkKeyHash> tiles;
+	std::vector<ChunkKey> hotTiles;
+	std::vector<DirtyRect> dirty;
+	ChunkPool<float> deltaPool;
+
+	Tile &unpackTile(const ChunkKey &key);
+	const float *tileDeltas(const Tile &tile, std::vector<float> &scratch) const;
+	void markDirty(DirtyRect rect);
+};
+
+// Rebuilds the normals of `map` (the composited window at world sample
+// (mapX, mapY)) around a rectangle whose heights changed. Neighbours past
+// the map edge are generated and composited like in GenerateHeightMap.
+// Returns the map space rectangle of samples whose heights or normals may
+// have changed, which is what vertex buffers and HeightPyramid::update need.
+DirtyRect refreshNormals(TerrainGenerator &generator, const EditLayer &edits, const HeightMap &map, int mapX, int mapY,
+	const DirtyRect &rect, NormalMap &normals, float cellSize = 1.0f, float heightScale = 1.0f);
+
+#endif
@@ -0,0 +1,462 @@
+#include "Hydrology.h"
+#include "../Parallel/ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <queue>
+#include <unordered_map>
+#include <utility>
+
+const int32_t LABEL_NONE = -1;
+const int32_t LABEL_OCEAN = 0;
+
+void FlowField::resize(int w, int h)
+{
+	width = w;
+	height = h;
+	primary.assign((size_t)w * h, FLOW_NONE);
+	secondary.assign((size_t)w * h, FLOW_NONE);
+	fraction.assign((size_t)w * h, 1.0f);
+}
+
+static uint64_t edgeKey(int32_t a, int32_t b)
+{
+	if(a > b)
+		std::swap(a, b);
+	return (uint64_t)(uint32_t)a << 32 | (uint32_t)b;
+}
+
+static void keepLowest(std::unordered_map<uint64_t, float> &edges, int32_t a, int32_t b, float weight)
+{
+	auto found = edges.emplace(edgeKey(a, b), weight);
+	if(!found.second && weight < found.first->second)
+		found.first->second = weight;
+}
+
+void fillDepressions(HeightMap &map, int tileSize)
+{
+	int w = map.width, h = map.height;
+	if(w < 3 || h < 3)
+		return;
+	tileSize = std::max(tileSize, 4);
+	int tilesX = (w + tileSize - 1) / tileSize;
+	int tilesY = (h + tileSize - 1) / tileSize;
+	int tileCount = tilesX * tilesY;
+	int labelsPerTile = 4 * tileSize;
+
+	std::vector<int32_t> labels((size_t)w * h, LABEL_NONE);
+	std::vector<std::unordered_map<uint64_t, float>> tileEdges(tileCount);
+
+	// 1. Flood every tile from its own border. Each border cell starts a
+	//    watershed label and the heights where watersheds meet become edges.
+	ThreadPool::global().parallelFor(tileCount, 1, [&](int first, int last) {
+		typedef std::pair<float, int> Entry;
+		for(int tile = first; tile < last; tile++)
+		{
+			int x0 = tile % tilesX * tileSize, y0 = tile / tilesX * tileSize;
+			int x1 = std::min(x0 + tileSize, w), y1 = std::min(y0 + tileSize, h);
+			std::unordered_map<uint64_t, float> &edges = tileEdges[tile];
+			std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> open;
+			std::deque<int> pit;
+
+			int32_t nextLabel = tile * labelsPerTile + 1;
+			for(int y = y0; y < y1; y++)
+			{
+				for(int x = x0; x < x1; x++)
+				{
+					if(x != x0 && x != x1 - 1 && y != y0 && y != y1 - 1)
+						continue;
+					size_t i = (size_t)y * w + x;
+					labels[i] = nextLabel++;
+					open.push(Entry(map.heights[i], (int)i));
+				}
+			}
+
+			while(!open.empty() || !pit.empty())
+			{
+				int c;
+				if(!pit.empty())
+				{
+					c = pit.front();
+					pit.pop_front();
+				}
+				else
+				{
+					c = open.top().second;
+					open.pop();
+				}
+				int cx = c % w, cy = c / w;
+				float level = map.heights[c];
+				for(int d = 0; d < 8; d++)
+				{
+					int nx = cx + FLOW_DX[d], ny = cy + FLOW_DY[d];
+					if(nx < x0 || ny < y0 || nx >= x1 || ny >= y1)
+						continue;
+					size_t n = (size_t)ny * w + nx;
+					if(labels[n] != LABEL_NONE)
+					{
+						if(labels[n] != labels[c])
+							keepLowest(edges, labels[c], labels[n], std::max(level, map.heights[n]));
+						continue;
+					}
+					labels[n] = labels[c];
+					// Cells inside a depression are raised and taken first in FIFO order.
+					if(map.heights[n] <= level)
+					{
+						map.heights[n] = level;
+						pit.push_back((int)n);
+					}
+					else
+					{
+						open.push(Entry(map.heights[n], (int)n));
+					}
+				}
+			}
+		}
+	});
+
+	// 2. Connect border cells to the neighbouring tiles and to the ocean
+	//    around the map. Only neighbours in later tiles are recorded, so each
+	//    cross-tile pair is seen once.
+	ThreadPool::global().parallelFor(tileCount, 1, [&](int first, int last) {
+		for(int tile = first; tile < last; tile++)
+		{
+			int x0 = tile % tilesX * tileSize, y0 = tile / tilesX * tileSize;
+			int x1 = std::min(x0 + tileSize, w), y1 = std::min(y0 + tileSize, h);
+			std::unordered_map<uint64_t, float> &edges = tileEdges[tile];
+			for(int y = y0; y < y1; y++)
+			{
+				for(int x = x0; x < x1; x++)
+				{
+					if(x != x0 && x != x1 - 1 && y != y0 && y != y1 - 1)
+						continue;
+					size_t i = (size_t)y * w + x;
+					if(x == 0 || y == 0 || x == w - 1 || y == h - 1)
+						keepLowest(edges, labels[i], LABEL_OCEAN, map.heights[i]);
+					for(int d = 0; d < 8; d++)
+					{
+						int nx = x + FLOW_DX[d], ny = y + FLOW_DY[d];
+						if(nx < 0 || ny < 0 || nx >= w || ny >= h)
+							continue;
+						int other = ny / tileSize * tilesX + nx / tileSize;
+						if(other <= tile)
+							continue;
+						size_t n = (size_t)ny * w + nx;
+						keepLowest(edges, labels[i], labels[n], std::max(map.heights[i], map.heights[n]));
+					}
+				}
+			}
+		}
+	});
+
+	// 3. Spill height of every watershed: the lowest possible maximum along a
+	//    path of edges to the ocean.
+	int32_t labelCount = tileCount * labelsPerTile + 1;
+	std::vector<std::vector<std::pair<int32_t, float>>> graph(labelCount);
+	for(const auto &edges : tileEdges)
+	{
+		for(const auto &edge : edges)
+		{
+			int32_t a = (int32_t)(edge.first >> 32), b = (int32_t)(uint32_t)edge.first;
+			graph[a].push_back(std::make_pair(b, edge.second));
+			graph[b].push_back(std::make_pair(a, edge.second));
+		}
+	}
+	std::vector<float> spill(labelCount, std::numeric_limits<float>::infinity());
+	typedef std::pair<float, int32_t> Node;
+	std::priority_queue<Node, std::vector<Node>, std::greater<Node>> open;
+	spill[LABEL_OCEAN] = -std::numeric_limits<float>::infinity();
+	open.push(Node(spill[LABEL_OCEAN], LABEL_OCEAN));
+	while(!open.empty())
+	{
+		Node node = open.top();
+		open.pop();
+		if(node.first > spill[node.second])
+			continue;
+		for(const auto &edge : graph[node.second])
+		{
+			float level = std::max(node.first, edge.second);
+			if(level < spill[edge.first])
+			{
+				spill[edge.first] = level;
+				open.push(Node(level, edge.first));
+			}
+		}
+	}
+
+	// 4. Raise every cell to the spill height of its watershed.
+	ThreadPool::global().parallelFor(h, 64, [&](int first, int last) {
+		for(size_t i = (size_t)first * w; i < (size_t)last * w; i++)
+			map.heights[i] = std::max(map.heights[i], spill[labels[i]]);
+	});
+}
+
+void computeFlowD8(const HeightMap &filled, FlowField &flow, float cellSize)
+{
+	int w = filled.width, h = filled.height;
+	flow.resize(w, h);
+	const float inverseCardinal = 1.0f / cellSize;
+	const float inverseDiagonal = 1.0f / (std::sqrt(2.0f) * cellSize);
+
+	ThreadPool::global().parallelFor(h, 64, [&](int first, int last) {
+		for(int y = first; y < last; y++)
+		{
+			for(int x = 0; x < w; x++)
+			{
+				float centre = filled.at(x, y);
+				float steepest = 0.0f;
+				uint8_t best = FLOW_NONE;
+				for(int d = 0; d < 8; d++)
+				{
+					int nx = x + FLOW_DX[d], ny = y + FLOW_DY[d];
+					if(nx < 0 || ny < 0 || nx >= w || ny >= h)
+						continue;
+					float slope = (centre - filled.at(nx, ny)) * ((d & 1) ? inverseDiagonal : inverseCardinal);
+					if(slope > steepest)
+					{
+						steepest = slope;
+						best = (uint8_t)d;
+					}
+				}
+				flow.primary[(size_t)y * w + x] = best;
+			}
+		}
+	});
+
+	// Drain flats: starting from cells that already drain (or sit on the map
+	// edge), walk breadth first over equal heights and point every flat cell
+	// back at the cell it was reached from.
+	auto drains = [&](int x, int y) {
+		return flow.primary[(size_t)y * w + x] != FLOW_NONE || x == 0 || y == 0 || x == w - 1 || y == h - 1;
+	};
+	std::vector<uint8_t> reached((size_t)w * h, 0);
+	int bands = (h + 63) / 64;
+	std::vector<std::vector<int>> seeds(bands);
+	ThreadPool::global().parallelFor(bands, 1, [&](int first, int last) {
+		for(int band = first; band < last; band++)
+		{
+			for(int y = band * 64; y < std::min(h, band * 64 + 64); y++)
+			{
+				for(int x = 0; x < w; x++)
+				{
+					if(!drains(x, y))
+						continue;
+					for(int d = 0; d < 8; d++)
+					{
+						int nx = x + FLOW_DX[d], ny = y + FLOW_DY[d];
+						if(nx >= 0 && ny >= 0 && nx < w && ny < h && !drains(nx, ny) && filled.at(nx, ny) == filled.at(x, y))
+						{
+							seeds[band].push_back(y * w + x);
+							break;
+						}
+					}
+				}
+			}
+		}
+	});
+	std::vector<int> frontier;
+	for(const std::vector<int> &band : seeds)
+		frontier.insert(frontier.end(), band.begin(), band.end());
+	for(size_t next = 0; next < frontier.size(); next++)
+	{
+		int c = frontier[next];
+		int cx = c % w, cy = c / w;
+		for(int d = 0; d < 8; d++)
+		{
+			int nx = cx + FLOW_DX[d], ny = cy + FLOW_DY[d];
+			if(nx < 0 || ny < 0 || nx >= w || ny >= h)
+				continue;
+			size_t n = (size_t)ny * w + nx;
+			if(reached[n] || drains(nx, ny) || filled.heights[n] != filled.heights[c])
+				continue;
+			reached[n] = 1;
+			flow.primary[n] = (uint8_t)((d + 4) & 7);
+			frontier.push_back((int)n);
+		}
+	}
+}
+
+void computeFlowDInfinity(const HeightMap &filled, FlowField &flow, float cellSize)
+{
+	// Flats and outlets keep their D8 receivers.
+	computeFlowD8(filled, flow, cellSize);
+	int w = filled.width, h = filled.height;
+	const float maxAngle = std::atan(1.0f);
+	const float diagonal = std::sqrt(2.0f) * cellSize;
+
+	ThreadPool::global().parallelFor(h, 64, [&](int first, int last) {
+		for(int y = first; y < last; y++)
+		{
+			for(int x = 0; x < w; x++)
+			{
+				float e0 = filled.at(x, y);
+				float steepest = 0.0f, angle = 0.0f;
+				int cardinal = -1, diagonalDir = -1;
+				// Facet k lies between directions k and k + 1, one of them cardinal.
+				for(int k = 0; k < 8; k++)
+				{
+					int c = (k & 1) ? (k + 1) & 7 : k;
+					int d = (k & 1) ? k : k + 1;
+					int cx = x + FLOW_DX[c], cy = y + FLOW_DY[c];
+					int dx = x + FLOW_DX[d], dy = y + FLOW_DY[d];
+					if(cx < 0 || cy < 0 || cx >= w || cy >= h || dx < 0 || dy < 0 || dx >= w || dy >= h)
+						continue;
+					float e1 = filled.at(cx, cy), e2 = filled.at(dx, dy);
+					float s1 = (e0 - e1) / cellSize;
+					float s2 = (e1 - e2) / cellSize;
+					// Facet angle clamped to [0, pi/4]; atan2 is only needed for the winner.
+					float s;
+					if(s2 <= 0.0f)
+						s = s1;
+					else if(s2 >= s1)
+						s = (e0 - e2) / diagonal;
+					else
+						s = std::sqrt(s1 * s1 + s2 * s2);
+					if(s > steepest)
+					{
+						steepest = s;
+						angle = s2 <= 0.0f ? 0.0f : s2 >= s1 ? maxAngle : std::atan2(s2, s1);
+						cardinal = c;
+						diagonalDir = d;
+					}
+				}
+				if(cardinal < 0)
+					continue;
+
+				size_t i = (size_t)y * w + x;
+				float toDiagonal = angle / maxAngle;
+				if(toDiagonal <= 0.0f)
+				{
+					flow.primary[i] = (uint8_t)cardinal;
+					flow.fraction[i] = 1.0f;
+				}
+				else if(toDiagonal >= 1.0f)
+				{
+					flow.primary[i] = (uint8_t)diagonalDir;
+					flow.fraction[i] = 1.0f;
+				}
+				else
+				{
+					flow.primary[i] = (uint8_t)cardinal;
+					flow.secondary[i] = (uint8_t)diagonalDir;
+					flow.fraction[i] = 1.0f - toDiagonal;
+				}
+			}
+		}
+	});
+}
+
+// Share of cell n's flow that ends up in the neighbour in direction d of n.
+static float shareTowards(const FlowField &flow, size_t n, int d)
+{
+	if(flow.primary[n] == d)
+		return flow.fraction[n];
+	if(flow.secondary[n] == d)
+		return 1.0f - flow.fraction[n];
+	return 0.0f;
+}
+
+void accumulateFlow(const FlowField &flow, std::vector<float> &accumulation)
+{
+	int w = flow.width, h = flow.height;
+	size_t count = (size_t)w * h;
+	accumulation.assign(count, 0.0f);
+	std::unique_ptr<std::atomic<int>[]> pending(new std::atomic<int>[count]);
+	std::vector<uint8_t> source(count);
+
+	// Number of donors of every cell, counted from the receiving side so no
+	// atomics are needed yet.
+	ThreadPool::global().parallelFor(h, 64, [&](int first, int last) {
+		for(int y = first; y < last; y++)
+		{
+			for(int x = 0; x < w; x++)
+			{
+				int donors = 0;
+				for(int d = 0; d < 8; d++)
+				{
+					int nx = x + FLOW_DX[d], ny = y + FLOW_DY[d];
+					if(nx >= 0 && ny >= 0 && nx < w && ny < h && shareTowards(flow, (size_t)ny * w + nx, (d + 4) & 7) > 0.0f)
+						donors++;
+				}
+				size_t i = (size_t)y * w + x;
+				pending[i].store(donors, std::memory_order_relaxed);
+				source[i] = donors == 0;
+			}
+		}
+	});
+
+	// Walk downstream from every source. The thread that resolves a cell's
+	// last donor owns that cell next, so every cell is summed exactly once.
+	ThreadPool::global().parallelFor(h, 16, [&](int first, int last) {
+		std::vector<size_t> stack;
+		for(size_t start = (size_t)first * w; start < (size_t)last * w; start++)
+		{
+			if(!source[start])
+				continue;
+			stack.push_back(start);
+			while(!stack.empty())
+			{
+				size_t c = stack.back();
+				stack.pop_back();
+				int cx = (int)(c % w), cy = (int)(c / w);
+				float total = 1.0f;
+				if(!source[c])
+				{
+					for(int d = 0; d < 8; d++)
+					{
+						int nx = cx + FLOW_DX[d], ny = cy + FLOW_DY[d];
+						if(nx < 0 || ny < 0 || nx >= w || ny >= h)
+							continue;
+						size_t n = (size_t)ny * w + nx;
+						float share = shareTowards(flow, n, (d + 4) & 7);
+						if(share > 0.0f)
+							total += accumulation[n] * share;
+					}
+				}
+				accumulation[c] = total;
+
+				uint8_t receivers[2] = { flow.primary[c], flow.secondary[c] };
+				for(uint8_t d : receivers)
+				{
+					if(d == FLOW_NONE)
+						continue;
+					int nx = cx + FLOW_DX[d], ny = cy + FLOW_DY[d];
+					if(nx < 0 || ny < 0 || nx >= w || ny >= h)
+						continue;
+					size_t n = (size_t)ny * w + nx;
+					if(pending[n].fetch_sub(1, std::memory_order_acq_rel) == 1)
+						stack.push_back(n);
+				}
+			}
+		}
+	});
+}
+
+void extractRivers(const std::vector<float> &accumulation, float threshold, std::vector<uint8_t> &rivers)
+{
+	rivers.resize(accumulation.size());
+	int count = (int)accumulation.size();
+	ThreadPool::global().parallelFor(count, 1 << 16, [&](int first, int last) {
+		for(int i = first; i < last; i++)
+			rivers[i] = accumulation[i] >= threshold;
+	});
+}
+
+void carveRivers(HeightMap &map, const std::vector<float> &accumulation, float threshold, float depth)
+{
+	int count = (int)map.heights.size();
+	ThreadPool::global().parallelFor(count, 1 << 16, [&](int first, int last) {
+		for(int i = first; i < last; i++)
+		{
+			if(accumulation[i] < threshold)
+				continue;
+			// Full depth once a river carries 16 times the threshold.
+			float strength = std::min(1.0f, 0.2f + 0.2f * std::log2(accumulation[i] / threshold));
+			map.heights[i] -= depth * strength;
+		}
+	});
+}
@@ -0,0 +1,47 @@
+#ifndef HYDROLOGY_H
+#define HYDROLOGY_H
+
+#include <cstdint>
+#include <vector>
+#include "../TerrainGenerator/HeightMap.h"
+
+// Neighbour order used by flow directions: E, SE, S, SW, W, NW, N, NE.
+const int FLOW_DX[8] = { 1, 1, 0, -1, -1, -1, 0, 1 };
+const int FLOW_DY[8] = { 0, 1, 1, 1, 0, -1, -1, -1 };
+// Cell drains off the map (or nowhere).
+const uint8_t FLOW_NONE = 255;
+
+// Up to two receivers per cell. D8 only uses the first one; D-infinity
+// splits the flow between the two neighbours of its steepest facet.
+struct FlowField
+{
+	int width = 0, height = 0;
+	std::vector<uint8_t> primary, secondary;
+	// Share of the cell's flow going to `primary`, the rest goes to `secondary`.
+	std::vector<float> fraction;
+
+	void resize(int w, int h);
+};
+
+// Raises every depression to its spill height so all water reaches the map
+// edge. Tiles are flooded in parallel from their borders; the spill heights
+// between the resulting watersheds are then solved on a small graph and
+// applied back to every tile (Barnes' parallel priority-flood).
+void fillDepressions(HeightMap &map, int tileSize = 256);
+
+// Steepest descent receivers. Flats left behind by filling drain towards
+// their outlets along the shortest path over the flat.
+void computeFlowD8(const HeightMap &filled, FlowField &flow, float cellSize = 1.0f);
+// Tarboton's D-infinity directions, falling back to D8 on flats.
+void computeFlowDInfinity(const HeightMap &filled, FlowField &flow, float cellSize = 1.0f);
+
+// Upstream cell count draining through every cell (each cell contributes 1).
+// Cells are resolved as soon as all of their donors are, in parallel.
+void accumulateFlow(const FlowField &flow, std::vector<float> &accumulation);
+
+// Marks cells whose accumulation reaches `threshold` with 1.
+void extractRivers(const std::vector<float> &accumulation, float threshold, std::vector<uint8_t> &rivers);
+// Lowers river cells, deeper for larger accumulation, up to `depth`.
+void carveRivers(HeightMap &map, const std::vector<float> &accumulation, float threshold, float depth);
+
+#endif
@@ -0,0 +1,182 @@
+#include "HorizonMap.h"
+#include "../Parallel/ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+
+// Grid lines swept per task.
+const int LINE_GRAIN = 16;
+// Texel rows shaded per task.
+const int SHADOW_GRAIN = 32;
+
+uint8_t encodeHorizon(float sine)
+{
+	sine = std::min(std::max(sine, 0.0f), 1.0f);
+	return (uint8_t)(std::sqrt(sine) * 255.0f + 0.5f);
+}
+
+float decodeHorizon(uint8_t value)
+{
+	float v = value * (1.0f / 255.0f);
+	return v * v;
+}
+
+void computeHorizonMap(const HeightMap &map, HorizonMap &out, float cellSize, float heightScale)
+{
+	const int width = map.width, height = map.height;
+	out.resize(width, height);
+	if(width == 0 || height == 0)
+		return;
+
+	for(int d = 0; d < HORIZON_DIRECTIONS; d++)
+	{
+		const int dx = HORIZON_DX[d], dy = HORIZON_DY[d];
+		const float stepLength = cellSize * (dx != 0 && dy != 0 ? std::sqrt(2.0f) : 1.0f);
+
+		// Lines start at the texels whose neighbour in direction d is off the
+		// map and are swept backwards, so the stack always holds the samples
+		// lying in direction d of the current one.
+		std::vector<int> starts;
+		int edgeX = dx > 0 ? width - 1 : 0;
+		int edgeY = dy > 0 ? height - 1 : 0;
+		if(dx != 0)
+		{
+			for(int y = 0; y < height; y++)
+				starts.push_back(y * width + edgeX);
+		}
+		if(dy != 0)
+		{
+			for(int x = 0; x < width; x++)
+			{
+				if(dx == 0 || x != edgeX)
+					starts.push_back(edgeY * width + x);
+			}
+		}
+
+		// The lines of a task advance in lockstep, so neighbouring lines read
+		// and write neighbouring texels even when sweeping along columns.
+		ThreadPool::global().parallelFor(starts.size(), LINE_GRAIN, [&](int first, int last) {
+			struct HullPoint
+			{
+				float t, h;
+			};
+			static thread_local std::vector<HullPoint> hulls[LINE_GRAIN];
+			int xs[LINE_GRAIN], ys[LINE_GRAIN];
+			// A serial run gets every line at once, so groups are formed here.
+			for(int group = first; group < last; group += LINE_GRAIN)
+			{
+				int lines = std::min(LINE_GRAIN, last - group), active = lines;
+				for(int i = 0; i < lines; i++)
+				{
+					hulls[i].clear();
+					xs[i] = starts[group + i] % width;
+					ys[i] = starts[group + i] / width;
+				}
+				for(int k = 0; active > 0; k++)
+				{
+					float t = k * stepLength;
+					for(int i = 0; i < lines; i++)
+					{
+						int x = xs[i], y = ys[i];
+						if(x < 0 || y < 0 || x >= width || y >= height)
+							continue;
+						std::vector<HullPoint> &hull = hulls[i];
+						float h = map.at(x, y) * heightScale;
+						// Drop hull points that the one below them on the stack hides from here.
+						while(hull.size() >= 2)
+						{
+							const HullPoint &top = hull.back(), &second = hull[hull.size() - 2];
+							if((second.h - h) * (t - top.t) < (top.h - h) * (t - second.t))
+								break;
+							hull.pop_back();
+						}
+						float sine = 0.0f;
+						if(!hull.empty() && hull.back().h > h)
+						{
+							float rise = hull.back().h - h, run = t - hull.back().t;
+							sine = rise / std::sqrt(rise * rise + run * run);
+						}
+						out.horizons[((size_t)y * width + x) * HORIZON_DIRECTIONS + d] = encodeHorizon(sine);
+						hull.push_back({ t, h });
+						xs[i] = x - dx;
+						ys[i] = y - dy;
+						if(xs[i] < 0 || ys[i] < 0 || xs[i] >= width || ys[i] >= height)
+							active--;
+					}
+				}
+			}
+		});
+	}
+}
+
+void computeAmbientOcclusion(const HorizonMap &horizons, std::vector<float> &occlusion)
+{
+	const int width = horizons.width, height = horizons.height;
+	occlusion.resize((size_t)width * height);
+	ThreadPool::global().parallelFor(height, SHADOW_GRAIN, [&](int first, int last) {
+		for(int y = first; y < last; y++)
+		{
+			for(int x = 0; x < width; x++)
+			{
+				const uint8_t *texel = horizons.texel(x, y);
+				float sum = 0.0f;
+				for(int d = 0; d < HORIZON_DIRECTIONS; d++)
+					sum += decodeHorizon(texel[d]);
+				occlusion[(size_t)y * width + x] = 1.0f - sum / HORIZON_DIRECTIONS;
+			}
+		}
+	});
+}
+
+// Everything sunVisibility needs that does not depend on the texel.
+struct SunSetup
+{
+	int first, second;
+	float blend;
+	// Horizon sines at which the sun starts and stops being covered.
+	float lit, covered;
+};
+
+static SunSetup setupSun(float azimuth, float elevation, float penumbra)
+{
+	const float sector = std::atan(1.0f);
+	float position = azimuth / sector;
+	position -= std::floor(position / HORIZON_DIRECTIONS) * HORIZON_DIRECTIONS;
+	SunSetup sun;
+	sun.first = std::min((int)position, HORIZON_DIRECTIONS - 1);
+	sun.second = (sun.first + 1) % HORIZON_DIRECTIONS;
+	sun.blend = position - sun.first;
+	sun.lit = std::sin(std::max(elevation - penumbra * 0.5f, -2.0f * sector));
+	sun.covered = std::sin(std::min(elevation + penumbra * 0.5f, 2.0f * sector));
+	return sun;
+}
+
+static float shadeTexel(const SunSetup &sun, const uint8_t *texel)
+{
+	float a = decodeHorizon(texel[sun.first]), b = decodeHorizon(texel[sun.second]);
+	float horizon = a + (b - a) * sun.blend;
+	if(horizon <= sun.lit)
+		return 1.0f;
+	if(horizon >= sun.covered)
+		return 0.0f;
+	float f = (sun.covered - horizon) / (sun.covered - sun.lit);
+	return f * f * (3.0f - 2.0f * f);
+}
+
+float sunVisibility(const HorizonMap &horizons, int x, int y, float azimuth, float elevation, float penumbra)
+{
+	return shadeTexel(setupSun(azimuth, elevation, penumbra), horizons.texel(x, y));
+}
+
+void computeSunShadows(const HorizonMap &horizons, float azimuth, float elevation, float penumbra, std::vector<uint8_t> &visibility)
+{
+	const int width = horizons.width, height = horizons.height;
+	const SunSetup sun = setupSun(azimuth, elevation, penumbra);
+	visibility.resize((size_t)width * height);
+	ThreadPool::global().parallelFor(height, SHADOW_GRAIN, [&](int first, int last) {
+		for(int y = first; y < last; y++)
+		{
+			for(int x = 0; x < width; x++)
+				visibility[(size_t)y * width + x] = (uint8_t)(shadeTexel(sun, horizons.texel(x, y)) * 255.0f + 0.5f);
+		}
+	});
+}
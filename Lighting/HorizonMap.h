@@ -0,0 +1,52 @@
+#ifndef HORIZONMAP_H
+#define HORIZONMAP_H
+
+#include <cstdint>
+#include <vector>
+#include "../TerrainGenerator/HeightMap.h"
+
+// Horizon directions, 45 degrees apart starting at +x and turning towards +y:
+// E, SE, S, SW, W, NW, N, NE in map space.
+const int HORIZON_DIRECTIONS = 8;
+const int HORIZON_DX[HORIZON_DIRECTIONS] = { 1, 1, 0, -1, -1, -1, 0, 1 };
+const int HORIZON_DY[HORIZON_DIRECTIONS] = { 0, 1, 1, 1, 0, -1, -1, -1 };
+
+// Sine of the horizon elevation of every texel in every direction.
+// The 8 directions of a texel are stored together, so the table uploads as
+// two RGBA8 texels per sample (directions 0-3 and 4-7). Values are square
+// root encoded for precision near the horizon, a shader decodes them with
+// `s = v * v` after normalizing v to [0, 1]. Terrain below the texel counts
+// as a flat horizon.
+struct HorizonMap
+{
+	int width = 0, height = 0;
+	std::vector<uint8_t> horizons;
+
+	void resize(int w, int h)
+	{
+		width = w;
+		height = h;
+		horizons.resize((size_t)w * h * HORIZON_DIRECTIONS);
+	}
+	const uint8_t *texel(int x, int y) const { return &horizons[((size_t)y * width + x) * HORIZON_DIRECTIONS]; }
+};
+
+uint8_t encodeHorizon(float sine);
+float decodeHorizon(uint8_t value);
+
+// Sweeps every grid line of every direction once, keeping the upper convex
+// hull of the samples already passed on a stack, so each texel's horizon is
+// found in amortized constant time. Lines of one direction run in parallel.
+void computeHorizonMap(const HeightMap &map, HorizonMap &out, float cellSize = 1.0f, float heightScale = 1.0f);
+
+// Open sky fraction, 1 - mean horizon sine, 1 for a texel that sees the whole sky.
+void computeAmbientOcclusion(const HorizonMap &horizons, std::vector<float> &occlusion);
+
+// Sun visibility in [0, 1] for a sun at `azimuth` radians (same convention
+// as the directions) and `elevation` radians above the horizon. The horizon
+// is interpolated between the two nearest directions and the shadow edge is
+// softened over `penumbra` radians.
+float sunVisibility(const HorizonMap &horizons, int x, int y, float azimuth, float elevation, float penumbra);
+void computeSunShadows(const HorizonMap &horizons, float azimuth, float elevation, float penumbra, std::vector<uint8_t> &visibility);
+
+#endif
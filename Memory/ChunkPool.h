@@ -0,0 +1,103 @@
+#ifndef CHUNKPOOL_H
+#define CHUNKPOOL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+struct ChunkPoolStats
+{
+	// Buffers handed out in total and how many of them were recycled.
+	size_t acquired = 0;
+	size_t reused = 0;
+	// Buffers that had to come from the system allocator.
+	size_t systemAllocations = 0;
+	size_t released = 0;
+	// Released buffers freed because the free list was full or they were too small.
+	size_t dropped = 0;
+	size_t live = 0;
+	size_t peakLive = 0;
+	size_t free = 0;
+};
+
+// Recycles fixed size chunk buffers (heights, normals, vertices, indices).
+// Buffers are plain vectors so they drop into HeightMap and friends
+// unchanged; released buffers keep their storage on a free list and are
+// handed out again without touching the system allocator. Recycled buffers
+// keep their old contents.
+template<typename T>
+class ChunkPool
+{
+public:
+	ChunkPool(size_t chunkElements, size_t maxFree = 64) : chunkElements(chunkElements), maxFree(maxFree) {}
+
+	size_t elementsPerChunk() const { return chunkElements; }
+
+	std::vector<T> acquire()
+	{
+		std::vector<T> buffer;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			counters.acquired++;
+			counters.live++;
+			counters.peakLive = std::max(counters.peakLive, counters.live);
+			if(!freeList.empty())
+			{
+				buffer = std::move(freeList.back());
+				freeList.pop_back();
+				counters.reused++;
+				return buffer;
+			}
+			counters.systemAllocations++;
+		}
+		buffer.resize(chunkElements);
+		return buffer;
+	}
+
+	void release(std::vector<T> &&buffer)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		counters.released++;
+		if(counters.live > 0)
+			counters.live--;
+		if(buffer.capacity() < chunkElements || freeList.size() >= maxFree)
+		{
+			counters.dropped++;
+			std::vector<T>().swap(buffer);
+			return;
+		}
+		// Within capacity, so this never reallocates.
+		buffer.resize(chunkElements);
+		freeList.push_back(std::move(buffer));
+	}
+
+	// Allocates up front so the first frames do not hit the system allocator either.
+	void reserve(size_t count)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		while(freeList.size() < count && freeList.size() < maxFree)
+		{
+			freeList.push_back(std::vector<T>(chunkElements));
+			counters.systemAllocations++;
+		}
+	}
+
+	ChunkPoolStats stats() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		ChunkPoolStats result = counters;
+		result.free = freeList.size();
+		return result;
+	}
+
+private:
+	size_t chunkElements;
+	size_t maxFree;
+	mutable std::mutex mutex;
+	std::vector<std::vector<T>> freeList;
+	ChunkPoolStats counters;
+};
+
+#endif
@@ -0,0 +1,111 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+static thread_local bool insideWorker = false;
+
+ThreadPool::ThreadPool(unsigned int threadCount)
+{
+	// The calling thread always helps, so it counts as one of the threads.
+	for(unsigned int i = 1; i < threadCount; i++)
+	{
+		workers.emplace_back(&ThreadPool::workerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for(std::thread &worker : workers)
+	{
+		worker.join();
+	}
+}
+
+ThreadPool &ThreadPool::global()
+{
+	static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+	return pool;
+}
+
+unsigned int ThreadPool::size() const
+{
+	return workers.size() + 1;
+}
+
+void ThreadPool::parallelFor(int count, int grain, const std::function<void(int, int)> &task)
+{
+	if(count <= 0)
+		return;
+	if(grain < 1)
+		grain = 1;
+
+	int pieces = (count + grain - 1) / grain;
+	if(workers.empty() || pieces == 1 || insideWorker)
+	{
+		task(0, count);
+		return;
+	}
+
+	// One job at a time; other submitting threads queue up here.
+	std::lock_guard<std::mutex> submit(submitMutex);
+	std::shared_ptr<Job> current = std::make_shared<Job>();
+	current->task = &task;
+	current->count = count;
+	current->grain = grain;
+	current->pieces = pieces;
+	current->nextPiece = 0;
+	current->pendingPieces = pieces;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job = current;
+		generation++;
+	}
+	wake.notify_all();
+
+	insideWorker = true;
+	runPieces(*current);
+	insideWorker = false;
+
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [&current] { return current->pendingPieces.load() == 0; });
+	job.reset();
+}
+
+void ThreadPool::workerLoop()
+{
+	insideWorker = true;
+	unsigned long long seen = 0;
+	while(true)
+	{
+		std::shared_ptr<Job> current;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this, seen] { return stopping || (job && generation != seen); });
+			if(stopping)
+				return;
+			seen = generation;
+			current = job;
+		}
+		runPieces(*current);
+	}
+}
+
+void ThreadPool::runPieces(Job &current)
+{
+	int piece;
+	while((piece = current.nextPiece++) < current.pieces)
+	{
+		int begin = piece * current.grain;
+		int end = std::min(begin + current.grain, current.count);
+		(*current.task)(begin, end);
+		if(--current.pendingPieces == 0)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			done.notify_all();
+		}
+	}
+}
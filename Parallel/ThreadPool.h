@@ -0,0 +1,49 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Small persistent worker pool shared by the terrain passes.
+// parallelFor splits [0, count) into pieces of `grain` items and runs them on the
+// workers and the calling thread. Calls made from inside a worker run serially.
+class ThreadPool
+{
+public:
+	ThreadPool(unsigned int threadCount);
+	~ThreadPool();
+
+	// Pool sized to the hardware, created on first use.
+	static ThreadPool &global();
+
+	unsigned int size() const;
+	void parallelFor(int count, int grain, const std::function<void(int, int)> &task);
+
+private:
+	struct Job
+	{
+		const std::function<void(int, int)> *task;
+		int count, grain, pieces;
+		std::atomic<int> nextPiece;
+		std::atomic<int> pendingPieces;
+	};
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::mutex submitMutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	std::shared_ptr<Job> job;
+	unsigned long long generation = 0;
+	bool stopping = false;
+
+	void workerLoop();
+	void runPieces(Job &current);
+};
+
+#endif
@@ -0,0 +1,440 @@
+#include "ChunkedTerrain.h"
+#include "VertexCache.h"
+#include "../Parallel/ThreadPool.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+ChunkedTerrain::ChunkedTerrain(int chunkQuads, int slotCount, ChunkVertexFormat format)
+	: quads(chunkQuads), slotVertices((chunkQuads + 1) * (chunkQuads + 1)), format(format), slots(slotCount)
+{
+}
+
+void ChunkedTerrain::create(GridIndexCache &indices, StreamBuffer &stream, GLuint program)
+{
+	this->stream = &stream;
+	uniforms.locate(program);
+	glGenVertexArrays(1, &vertexArray);
+	glBindVertexArray(vertexArray);
+
+	grid = &indices.getStitched(quads);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, grid->buffer);
+
+	// A range per slot, as large as the full resolution triangles.
+	slotIndices = grid->count(0, 0);
+	glGenBuffers(1, &simplifiedBuffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, simplifiedBuffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)(slots.size() * slotIndices * indexSize()), nullptr, GL_DYNAMIC_DRAW);
+
+	glGenBuffers(1, &vertexBuffer);
+	allocateSlots();
+}
+
+void ChunkedTerrain::allocateSlots()
+{
+	// Storage for every slot up front, chunks only ever write into it.
+	glBindVertexArray(vertexArray);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)(slots.size() * slotVertices * vertexSize()), nullptr, GL_DYNAMIC_DRAW);
+
+	if(format == CHUNK_VERTEX_PACKED)
+	{
+		// Heights only, normalized so the shader sees fractions of the packed range.
+		glDisableVertexAttribArray(0);
+		glVertexAttribPointer(1, 1, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(uint16_t), (void*)0);
+		glEnableVertexAttribArray(1);
+	}
+	else
+	{
+		// Position attributes.
+		glDisableVertexAttribArray(1);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex3D), (void*)0);
+		glEnableVertexAttribArray(0);
+	}
+}
+
+void ChunkedTerrain::setFormat(ChunkVertexFormat newFormat)
+{
+	if(newFormat == format)
+		return;
+	format = newFormat;
+	for(Slot &slot : slots)
+		slot.used = false;
+	resident.clear();
+	if(vertexBuffer)
+		allocateSlots();
+}
+
+void ChunkedTerrain::destroy()
+{
+	// Futures from std::async wait for their task when destroyed.
+	simplifyJobs.clear();
+	glDeleteBuffers(1, &simplifiedBuffer);
+	simplifiedBuffer = 0;
+	glDeleteBuffers(1, &vertexBuffer);
+	glDeleteVertexArrays(1, &vertexArray);
+	vertexBuffer = vertexArray = 0;
+	for(Slot &slot : slots)
+	{
+		slot.used = false;
+		slot.simplifying = false;
+	}
+	resident.clear();
+}
+
+int ChunkedTerrain::update(TerrainGenerator &gen, int x0, int y0, int x1, int y1)
+{
+	// New parameters invalidate every resident chunk where it stands.
+	uint64_t hash = gen.getParameterHash();
+	bool stale = hash != parameterHash;
+	parameterHash = hash;
+
+	for(size_t i = 0; i < slots.size(); i++)
+	{
+		Slot &slot = slots[i];
+		if(slot.used && (slot.key.x < x0 || slot.key.x >= x1 || slot.key.y < y0 || slot.key.y >= y1))
+		{
+			resident.erase(slot.key);
+			slot.used = false;
+		}
+	}
+
+	int uploaded = 0;
+	if(stale)
+	{
+		for(auto &entry : resident)
+		{
+			upload(gen, entry.second);
+			uploaded++;
+		}
+	}
+
+	size_t freeSlot = 0;
+	for(int y = y0; y < y1; y++)
+	{
+		for(int x = x0; x < x1; x++)
+		{
+			ChunkKey key(x, y);
+			if(resident.count(key))
+				continue;
+			while(freeSlot < slots.size() && slots[freeSlot].used)
+				freeSlot++;
+			if(freeSlot == slots.size())
+			{
+				std::cout << "ERROR::TERRAIN::OUT_OF_CHUNK_SLOTS" << std::endl;
+				return uploaded;
+			}
+			slots[freeSlot].key = key;
+			slots[freeSlot].used = true;
+			slots[freeSlot].lod = 0;
+			slots[freeSlot].coarserEdges = 0;
+			resident[key] = (int)freeSlot;
+			upload(gen, (int)freeSlot);
+			uploaded++;
+		}
+	}
+	return uploaded;
+}
+
+void ChunkedTerrain::upload(TerrainGenerator &gen, int slot)
+{
+	Slot &target = slots[slot];
+	gen.GenerateChunk(target.key, quads, target.heights);
+	if(edits)
+		edits->composite(target.heights, target.key.x * quads, target.key.y * quads);
+	target.simplifiedLod = -1;
+	target.heightsVersion++;
+	target.visible = true;
+	updateBounds(target);
+	writeRows(slot, 0, quads + 1);
+}
+
+int ChunkedTerrain::applyEdits(TerrainGenerator &gen, const DirtyRect &rect)
+{
+	const int width = quads + 1;
+	int touched = 0;
+	for(size_t i = 0; i < slots.size(); i++)
+	{
+		Slot &slot = slots[i];
+		if(!slot.used)
+			continue;
+		// A chunk holds samples [x, x + quads] x [y, y + quads], sharing its last
+		// row and column with its neighbours.
+		int x = slot.key.x * quads, y = slot.key.y * quads;
+		int first = std::max(rect.y0 - y, 0), last = std::min(rect.y1 - y, width);
+		if(first >= last || rect.x1 <= x || rect.x0 >= x + width)
+			continue;
+		// Deltas are relative to the generated heights, so the rows start over from those.
+		float *rows = slot.heights.row(first);
+		gen.GenerateHeights(x, y + first, width, last - first, rows, width);
+		if(edits)
+			edits->composite(x, y + first, width, last - first, rows, width);
+		slot.simplifiedLod = -1;
+		slot.heightsVersion++;
+		updateBounds(slot);
+		writeRows((int)i, first, last);
+		touched++;
+	}
+	return touched;
+}
+
+void ChunkedTerrain::updateBounds(Slot &slot)
+{
+	auto range = std::minmax_element(slot.heights.heights.begin(), slot.heights.heights.end());
+	slot.minHeight = *range.first;
+	slot.maxHeight = *range.second;
+}
+
+void ChunkedTerrain::writeRows(int slot, int first, int last)
+{
+	const HeightMap &heights = slots[slot].heights;
+	const size_t count = (size_t)heights.width * (last - first);
+	const size_t size = count * vertexSize();
+	const GLintptr rowsOffset = (GLintptr)((slot * slotVertices + (size_t)first * heights.width) * vertexSize());
+	// Chunk-local vertices, the chunk origin is a uniform.
+	auto build = [&](void *out) {
+		if(format == CHUNK_VERTEX_PACKED)
+			packGridHeights(heights.row(first), count, (uint16_t*)out);
+		else
+			buildGridVertices(heights, 1.0f, first, last, (Vertex3D*)out, 0.0f, 0.0f);
+	};
+	GLintptr offset;
+	if(void *staged = stream->map(size, offset))
+	{
+		build(staged);
+		stream->unmap();
+		glBindBuffer(GL_COPY_READ_BUFFER, stream->buffer());
+		glBindBuffer(GL_COPY_WRITE_BUFFER, vertexBuffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offset, rowsOffset, size);
+		return;
+	}
+	// The frame's staging region is full, e.g. after a parameter change.
+	void *out;
+	if(format == CHUNK_VERTEX_PACKED)
+	{
+		packed.resize(count);
+		out = packed.data();
+	}
+	else
+	{
+		vertices.resize(count);
+		out = vertices.data();
+	}
+	build(out);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	glBufferSubData(GL_ARRAY_BUFFER, rowsOffset, size, out);
+}
+
+void ChunkedTerrain::selectLods(float viewX, float viewY, float lodDistance)
+{
+	for(Slot &slot : slots)
+	{
+		if(!slot.used)
+			continue;
+		float x0 = (float)slot.key.x * quads, y0 = (float)slot.key.y * quads;
+		float dx = std::max(std::max(x0 - viewX, viewX - (x0 + quads)), 0.0f);
+		float dy = std::max(std::max(y0 - viewY, viewY - (y0 + quads)), 0.0f);
+		float distance = std::sqrt(dx * dx + dy * dy);
+		slot.distance = distance;
+		int lod = 0;
+		while(lod + 1 < grid->lods && distance >= lodDistance * (float)(1 << lod))
+			lod++;
+		slot.lod = lod;
+	}
+
+	static const int EDGE_DX[4] = { -1, 1, 0, 0 }, EDGE_DY[4] = { 0, 0, -1, 1 };
+	static const int EDGE_BITS[4] = { EDGE_MIN_X, EDGE_MAX_X, EDGE_MIN_Y, EDGE_MAX_Y };
+	auto neighbour = [&](const Slot &slot, int edge) -> const Slot* {
+		auto found = resident.find(ChunkKey(slot.key.x + EDGE_DX[edge], slot.key.y + EDGE_DY[edge]));
+		return found == resident.end() ? nullptr : &slots[found->second];
+	};
+	// Refine until no chunk is more than one LOD coarser than a neighbour,
+	// which only ever lowers LODs and so settles.
+	bool changed = true;
+	while(changed)
+	{
+		changed = false;
+		for(Slot &slot : slots)
+		{
+			for(int edge = 0; slot.used && edge < 4; edge++)
+			{
+				const Slot *other = neighbour(slot, edge);
+				if(other && slot.lod > other->lod + 1)
+				{
+					slot.lod = other->lod + 1;
+					changed = true;
+				}
+			}
+		}
+	}
+	for(Slot &slot : slots)
+	{
+		slot.coarserEdges = 0;
+		for(int edge = 0; slot.used && edge < 4; edge++)
+		{
+			const Slot *other = neighbour(slot, edge);
+			if(other && other->lod > slot.lod)
+				slot.coarserEdges |= EDGE_BITS[edge];
+		}
+	}
+	simplifyFarChunks();
+}
+
+void ChunkedTerrain::setSimplification(float distance, float maxError)
+{
+	simplifyDistance = distance;
+	if(maxError != simplifyError)
+	{
+		for(Slot &slot : slots)
+			slot.simplifiedLod = -1;
+	}
+	simplifyError = maxError;
+}
+
+bool ChunkedTerrain::simplified(const Slot &slot) const
+{
+	return simplifyDistance > 0.0f && slot.distance >= simplifyDistance
+		&& slot.simplifiedLod == slot.lod && slot.simplifiedEdges == slot.coarserEdges;
+}
+
+void ChunkedTerrain::simplifyFarChunks()
+{
+	finishSimplifyJobs();
+	if(simplifyDistance <= 0.0f)
+		return;
+	// Never waited on by the GL thread, and never more jobs than cores so chunk
+	// generation still finds the workers free.
+	const size_t maxJobs = ThreadPool::global().size();
+	for(size_t i = 0; i < slots.size() && simplifyJobs.size() < maxJobs; i++)
+	{
+		Slot &slot = slots[i];
+		if(!slot.used || slot.simplifying || slot.distance < simplifyDistance || simplified(slot))
+			continue;
+		std::unique_ptr<SimplifyJob> job(new SimplifyJob());
+		job->slot = (int)i;
+		job->key = slot.key;
+		job->lod = slot.lod;
+		job->coarserEdges = slot.coarserEdges;
+		job->heightsVersion = slot.heightsVersion;
+		job->maxError = simplifyError;
+		job->heights = slot.heights;
+		SimplifyJob *work = job.get();
+		const int gridQuads = quads, vertices = slotVertices;
+		job->done = std::async(std::launch::async, [work, gridQuads, vertices]() {
+			std::vector<uint32_t> input;
+			buildStitchedGridIndices(gridQuads, work->lod, work->coarserEdges, input);
+			simplifyGridChunk(work->heights, 1.0f, input, work->maxError, work->indices);
+			optimizeVertexCache(work->indices.data(), work->indices.size(), vertices);
+		});
+		slot.simplifying = true;
+		simplifyJobs.push_back(std::move(job));
+	}
+}
+
+void ChunkedTerrain::finishSimplifyJobs()
+{
+	std::vector<uint16_t> narrow;
+	size_t running = 0;
+	for(size_t j = 0; j < simplifyJobs.size(); j++)
+	{
+		SimplifyJob &job = *simplifyJobs[j];
+		if(job.done.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		{
+			simplifyJobs[running++] = std::move(simplifyJobs[j]);
+			continue;
+		}
+		job.done.get();
+		Slot &slot = slots[job.slot];
+		slot.simplifying = false;
+		// The slot moved on while the job ran, a later call starts it over.
+		if(!slot.used || !(slot.key == job.key) || slot.heightsVersion != job.heightsVersion
+			|| slot.lod != job.lod || slot.coarserEdges != job.coarserEdges || job.maxError != simplifyError)
+		{
+			continue;
+		}
+
+		const std::vector<uint32_t> &indices = job.indices;
+		GLintptr offset = (GLintptr)(job.slot * slotIndices * indexSize());
+		glBindBuffer(GL_COPY_WRITE_BUFFER, simplifiedBuffer);
+		if(grid->type == GL_UNSIGNED_SHORT)
+		{
+			narrow.assign(indices.begin(), indices.end());
+			glBufferSubData(GL_COPY_WRITE_BUFFER, offset, narrow.size() * sizeof(uint16_t), narrow.data());
+		}
+		else
+		{
+			glBufferSubData(GL_COPY_WRITE_BUFFER, offset, indices.size() * sizeof(uint32_t), indices.data());
+		}
+		slot.simplifiedLod = job.lod;
+		slot.simplifiedEdges = job.coarserEdges;
+		slot.simplifiedCount = (GLsizei)indices.size();
+	}
+	simplifyJobs.resize(running);
+}
+
+CullStats ChunkedTerrain::cull(const glm::mat4 &modelViewProjection, int originRow)
+{
+	bounds.clear();
+	boundSlots.clear();
+	for(size_t i = 0; i < slots.size(); i++)
+	{
+		const Slot &slot = slots[i];
+		if(!slot.used)
+			continue;
+		float x0 = (float)(slot.key.x * quads), y0 = (float)(slot.key.y * quads - originRow);
+		bounds.add(x0, y0, slot.minHeight, x0 + quads, y0 + quads, slot.maxHeight);
+		boundSlots.push_back((int)i);
+	}
+	boundVisible.resize(bounds.size());
+
+	CullStats stats;
+	stats.visible = cullBoxes(extractFrustum(modelViewProjection), bounds, boundVisible.data());
+	stats.culled = (int)bounds.size() - stats.visible;
+	for(size_t j = 0; j < boundSlots.size(); j++)
+		slots[boundSlots[j]].visible = boundVisible[j] != 0;
+	return stats;
+}
+
+size_t ChunkedTerrain::triangleCount() const
+{
+	size_t count = 0;
+	for(const Slot &slot : slots)
+	{
+		if(slot.used && slot.visible)
+			count += simplified(slot) ? slot.simplifiedCount : grid->count(slot.lod, slot.coarserEdges);
+	}
+	return count / 3;
+}
+
+void ChunkedTerrain::draw(int originRow) const
+{
+	glBindVertexArray(vertexArray);
+	glUniform1i(uniforms.vertexMode, format == CHUNK_VERTEX_PACKED ? VERTEX_MODE_PACKED : VERTEX_MODE_POSITION);
+	glUniform1i(uniforms.gridWidth, quads + 1);
+	glUniform1i(uniforms.gridVertices, slotVertices);
+	glUniform1f(uniforms.heightMin, PACKED_HEIGHT_MIN);
+	glUniform1f(uniforms.heightMax, PACKED_HEIGHT_MAX);
+	// Chunks on the shared stitched sets first, then the simplified ones.
+	for(int pass = 0; pass < 2; pass++)
+	{
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pass == 0 ? grid->buffer : simplifiedBuffer);
+		for(size_t i = 0; i < slots.size(); i++)
+		{
+			const Slot &slot = slots[i];
+			if(!slot.used || !slot.visible || simplified(slot) != (pass == 1))
+				continue;
+			glUniform2i(uniforms.chunkOrigin, slot.key.x * quads, slot.key.y * quads - originRow);
+			if(pass == 0)
+			{
+				glDrawElementsBaseVertex(GL_TRIANGLES, grid->count(slot.lod, slot.coarserEdges), grid->type,
+					(void*)grid->offset(slot.lod, slot.coarserEdges), (GLint)i * slotVertices);
+			}
+			else
+			{
+				glDrawElementsBaseVertex(GL_TRIANGLES, slot.simplifiedCount, grid->type,
+					(void*)(i * slotIndices * indexSize()), (GLint)i * slotVertices);
+			}
+		}
+	}
+}
@@ -0,0 +1,168 @@
+#ifndef CHUNKEDTERRAIN_H
+#define CHUNKEDTERRAIN_H
+
+#ifndef GL
+#define GL
+
+#include <SDL2/SDL.h>
+#include <GL/glew.h>
+
+#endif
+
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "StreamBuffer.h"
+#include "FrustumCull.h"
+#include "MeshSimplifier.h"
+#include "TerrainMesh.h"
+#include "../Editing/EditLayer.h"
+#include "../TerrainGenerator/ChunkKey.h"
+#include "../TerrainGenerator/TerrainGenerator.h"
+
+// Vertex layouts a chunk can be stored in.
+enum ChunkVertexFormat
+{
+	// Vertex3D, 12 bytes: chunk-local x and y and the height as floats.
+	CHUNK_VERTEX_FLOAT,
+	// 2 bytes: the height packed to 16 bits, x and y implicit in the vertex
+	// index, see packGridHeights.
+	CHUNK_VERTEX_PACKED
+};
+
+// Chunks left and culled by the last ChunkedTerrain::cull.
+struct CullStats
+{
+	int visible = 0;
+	int culled = 0;
+};
+
+// Terrain kept on the GPU as square chunks, each in a fixed slot of one
+// vertex buffer, all drawn from the same stitched grid index buffer. A
+// chunk's LOD only picks which index range it draws, its vertices stay the
+// full resolution ones. A chunk is
+// generated and copied into its slot only when it
+// becomes visible or the generator parameters change, so frames where the
+// visible set stays the same upload nothing.
+class ChunkedTerrain
+{
+public:
+	ChunkedTerrain(int chunkQuads, int slotCount, ChunkVertexFormat format = CHUNK_VERTEX_PACKED);
+
+	// Creates the vertex array and buffers, needs a current GL context.
+	// Chunks are written into `stream` and copied into their slots from there,
+	// and drawn with the terrain uniforms of `program`.
+	void create(GridIndexCache &indices, StreamBuffer &stream, GLuint program);
+	// Deletes them, must run while the context is still current.
+	void destroy();
+	// Switches the vertex layout, dropping every resident chunk.
+	void setFormat(ChunkVertexFormat format);
+
+	// Makes chunks [x0, x1) x [y0, y1) resident and frees every other slot.
+	// Returns the number of chunks generated and uploaded.
+	int update(TerrainGenerator &gen, int x0, int y0, int x1, int y1);
+	// Composites `edits` over every chunk generated from now on, nullptr for none.
+	void setEdits(const EditLayer *edits) { this->edits = edits; }
+	// Brings the resident chunks up to date with an EditLayer dirty rectangle
+	// (world samples): only the rows it covers are regenerated, composited
+	// and rewritten in their slots. Returns the number of chunks touched.
+	int applyEdits(TerrainGenerator &gen, const DirtyRect &rect);
+	// Picks every resident chunk's LOD from its distance to (viewX, viewY) in
+	// world samples: LOD 0 closer than lodDistance, then one LOD per doubling.
+	// Neighbours are kept within one LOD of each other so the stitching masks
+	// can close every seam.
+	void selectLods(float viewX, float viewY, float lodDistance);
+	// Chunks at least `distance` samples from the view are drawn with their LOD
+	// and stitching triangles simplified by simplifyGridChunk to `maxError`,
+	// recomputed whenever a far chunk's LOD, neighbours or heights change. The
+	// simplification runs in the background, one task per chunk, and a chunk
+	// keeps drawing its stitched triangles until its result is uploaded on a
+	// later selectLods. A distance of 0 turns it off.
+	void setSimplification(float distance, float maxError);
+	// Tests every resident chunk's bounds against the frustum of
+	// `modelViewProjection`, with chunks placed relative to world row
+	// `originRow` as draw() places them. draw() skips the culled ones.
+	CullStats cull(const glm::mat4 &modelViewProjection, int originRow);
+	// Binds the vertex array and draws every resident chunk that was not
+	// culled, placed relative to world row `originRow`.
+	void draw(int originRow) const;
+
+	int chunkQuads() const { return quads; }
+	int residentCount() const { return (int)resident.size(); }
+	// Triangles the next draw() issues.
+	size_t triangleCount() const;
+	ChunkVertexFormat vertexFormat() const { return format; }
+
+private:
+	// A chunk being simplified in the background, on its own copy of the inputs.
+	struct SimplifyJob
+	{
+		int slot;
+		ChunkKey key;
+		int lod, coarserEdges;
+		uint32_t heightsVersion;
+		float maxError;
+		HeightMap heights;
+		std::vector<uint32_t> indices;
+		std::future<void> done;
+	};
+
+	struct Slot
+	{
+		ChunkKey key;
+		bool used = false;
+		int lod = 0;
+		// Edges bordering a coarser neighbour, see GridEdge.
+		int coarserEdges = 0;
+		float distance = 0.0f;
+		// The simplified triangles in the slot's range of the simplified index
+		// buffer are for this LOD and mask, lod -1 when there are none.
+		int simplifiedLod = -1, simplifiedEdges = 0;
+		GLsizei simplifiedCount = 0;
+		// Bumped whenever the heights change, so results computed from older ones are dropped.
+		uint32_t heightsVersion = 0;
+		bool simplifying = false;
+		// Composited heights, kept for simplification and edits.
+		HeightMap heights;
+		float minHeight = 0.0f, maxHeight = 0.0f;
+		bool visible = true;
+	};
+
+	int quads;
+	int slotVertices;
+	ChunkVertexFormat format;
+	std::vector<Slot> slots;
+	std::unordered_map<ChunkKey, int, ChunkKeyHash> resident;
+	uint64_t parameterHash = 0;
+
+	GLuint vertexArray = 0, vertexBuffer = 0;
+	const StitchedGridIndices *grid = nullptr;
+	GLuint simplifiedBuffer = 0;
+	size_t slotIndices = 0;
+	float simplifyDistance = 0.0f, simplifyError = 0.0f;
+	std::vector<std::unique_ptr<SimplifyJob>> simplifyJobs;
+	BoxList bounds;
+	std::vector<int> boundSlots;
+	std::vector<uint8_t> boundVisible;
+	StreamBuffer *stream = nullptr;
+	const EditLayer *edits = nullptr;
+	TerrainUniforms uniforms;
+
+	std::vector<Vertex3D> vertices;
+	std::vector<uint16_t> packed;
+
+	size_t indexSize() const { return grid->type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t); }
+	size_t vertexSize() const { return format == CHUNK_VERTEX_PACKED ? sizeof(uint16_t) : sizeof(Vertex3D); }
+	void allocateSlots();
+	void upload(TerrainGenerator &gen, int slot);
+	// Writes rows [first, last) of a slot's heights into its vertices.
+	void writeRows(int slot, int first, int last);
+	void updateBounds(Slot &slot);
+	bool simplified(const Slot &slot) const;
+	void simplifyFarChunks();
+	void finishSimplifyJobs();
+};
+
+#endif
@@ -0,0 +1,125 @@
+#include "DisplacedTerrain.h"
+#include <algorithm>
+#include <cstdlib>
+
+DisplacedTerrain::DisplacedTerrain(int quadsX, int quadsY) : quadsX(quadsX), quadsY(quadsY)
+{
+}
+
+void DisplacedTerrain::create(GridIndexCache &indices, StreamBuffer &stream, GLuint program)
+{
+	this->stream = &stream;
+	uniforms.locate(program);
+	glGenVertexArrays(1, &vertexArray);
+	glBindVertexArray(vertexArray);
+
+	grid = indices.get(quadsX, quadsY);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, grid.buffer);
+
+	// texelFetch ignores filtering, but the texture must still be complete,
+	// which with the default mipmapped minification filter it is not.
+	glGenTextures(1, &heightTexture);
+	glBindTexture(GL_TEXTURE_2D, heightTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, quadsX + 1, rows(), 0, GL_RED, GL_FLOAT, nullptr);
+	resident = false;
+}
+
+void DisplacedTerrain::destroy()
+{
+	glDeleteTextures(1, &heightTexture);
+	glDeleteVertexArrays(1, &vertexArray);
+	heightTexture = vertexArray = 0;
+	resident = false;
+}
+
+int DisplacedTerrain::update(TerrainGenerator &gen, int firstRow)
+{
+	uint64_t hash = gen.getParameterHash();
+	const int count = rows();
+	int first = firstRow, uploaded = count;
+	if(resident && hash == parameterHash)
+	{
+		// Only the rows the window moved over, unless it jumped past all of them.
+		int moved = firstRow - residentFirst;
+		if(moved == 0)
+			return 0;
+		if(std::abs(moved) < count)
+		{
+			first = moved > 0 ? residentFirst + count : firstRow;
+			uploaded = std::abs(moved);
+		}
+	}
+	uploadRows(gen, first, uploaded);
+	residentFirst = firstRow;
+	resident = true;
+	parameterHash = hash;
+	return uploaded;
+}
+
+int DisplacedTerrain::applyEdits(TerrainGenerator &gen, const DirtyRect &rect)
+{
+	if(!resident || rect.x1 <= 0 || rect.x0 > quadsX)
+		return 0;
+	int first = std::max(rect.y0, residentFirst), last = std::min(rect.y1, residentFirst + rows());
+	if(first >= last)
+		return 0;
+	uploadRows(gen, first, last - first);
+	return last - first;
+}
+
+void DisplacedTerrain::uploadRows(TerrainGenerator &gen, int first, int count)
+{
+	const int width = quadsX + 1, ring = rows();
+	const size_t size = (size_t)width * count * sizeof(float);
+	GLintptr offset = 0;
+	const float *source;
+	float *staged = (float*)stream->map(size, offset);
+	if(staged)
+	{
+		// Generated straight into the staging buffer and unpacked from there.
+		gen.GenerateHeights(0.0, first, width, count, staged, width);
+		if(edits)
+			edits->composite(0, first, width, count, staged, width);
+		stream->unmap();
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stream->buffer());
+		source = (const float*)offset;
+	}
+	else
+	{
+		staging.resize((size_t)width * count);
+		gen.GenerateHeights(0.0, first, width, count, staging.data(), width);
+		if(edits)
+			edits->composite(0, first, width, count, staging.data(), width);
+		source = staging.data();
+	}
+
+	glBindTexture(GL_TEXTURE_2D, heightTexture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	// At most two runs, split where the rows wrap around the ring.
+	int done = 0;
+	while(done < count)
+	{
+		int slot = ((first + done) % ring + ring) % ring;
+		int run = std::min(count - done, ring - slot);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, slot, width, run, GL_RED, GL_FLOAT, source + (size_t)done * width);
+		done += run;
+	}
+	if(staged)
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void DisplacedTerrain::draw(int unit, int originRow) const
+{
+	glActiveTexture(GL_TEXTURE0 + unit);
+	glBindTexture(GL_TEXTURE_2D, heightTexture);
+	glBindVertexArray(vertexArray);
+	glUniform1i(uniforms.vertexMode, VERTEX_MODE_DISPLACED);
+	glUniform1i(uniforms.gridWidth, quadsX + 1);
+	glUniform1i(uniforms.gridVertices, (quadsX + 1) * rows());
+	glUniform1i(uniforms.firstRow, residentFirst);
+	glUniform2i(uniforms.chunkOrigin, 0, residentFirst - originRow);
+	glDrawElements(GL_TRIANGLES, grid.count, grid.type, (void*)0);
+}
@@ -0,0 +1,69 @@
+#ifndef DISPLACEDTERRAIN_H
+#define DISPLACEDTERRAIN_H
+
+#ifndef GL
+#define GL
+
+#include <SDL2/SDL.h>
+#include <GL/glew.h>
+
+#endif
+
+#include <cstdint>
+#include <vector>
+#include "StreamBuffer.h"
+#include "TerrainMesh.h"
+#include "../Editing/EditLayer.h"
+#include "../TerrainGenerator/TerrainGenerator.h"
+
+// Terrain drawn as one grid displaced in the vertex shader. The grid has no
+// vertex data at all, positions follow from gl_VertexID; the heights of the
+// visible rows live in an R32F texture used as a ring, world row r in
+// texture row r mod rows(), so scrolling uploads just the rows that entered
+// the window (one float per vertex) with glTexSubImage2D.
+class DisplacedTerrain
+{
+public:
+	// A window of quadsX x quadsY quads, starting at world column 0.
+	DisplacedTerrain(int quadsX, int quadsY);
+
+	// Creates the grid and the texture, needs a current GL context. Rows are
+	// written into `stream` and unpacked into the texture from there, the
+	// grid is drawn with the terrain uniforms of `program`.
+	void create(GridIndexCache &indices, StreamBuffer &stream, GLuint program);
+	// Deletes them, must run while the context is still current.
+	void destroy();
+
+	// Makes rows [firstRow, firstRow + rows()) resident, generating only the
+	// ones that are not, or all of them when the generator parameters change.
+	// Returns the number of rows uploaded.
+	int update(TerrainGenerator &gen, int firstRow);
+	// Composites `edits` over every row generated from now on, nullptr for none.
+	void setEdits(const EditLayer *edits) { this->edits = edits; }
+	// Regenerates and uploads the resident rows an EditLayer dirty rectangle
+	// (world samples) covers. Returns the number of rows uploaded.
+	int applyEdits(TerrainGenerator &gen, const DirtyRect &rect);
+	// Binds the height texture to texture unit `unit` and draws the grid,
+	// placed relative to world row `originRow`.
+	void draw(int unit, int originRow) const;
+
+	int rows() const { return quadsY + 1; }
+
+private:
+	int quadsX, quadsY;
+	int residentFirst = 0;
+	bool resident = false;
+	uint64_t parameterHash = 0;
+
+	GLuint vertexArray = 0, heightTexture = 0;
+	GridIndices grid;
+	StreamBuffer *stream = nullptr;
+	const EditLayer *edits = nullptr;
+	TerrainUniforms uniforms;
+
+	std::vector<float> staging;
+
+	void uploadRows(TerrainGenerator &gen, int first, int count);
+};
+
+#endif
@@ -0,0 +1,115 @@
+#include "FrustumCull.h"
+#include <cmath>
+#if defined(__AVX__) || defined(__SSE__)
+#include <immintrin.h>
+#endif
+
+Frustum extractFrustum(const glm::mat4 &m)
+{
+	// Rows of the matrix, glm stores it column-major.
+	glm::vec4 rows[4];
+	for(int i = 0; i < 4; i++)
+		rows[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+
+	// Clip space keeps -w <= x, y, z <= w.
+	Frustum frustum;
+	for(int axis = 0; axis < 3; axis++)
+	{
+		frustum.planes[axis * 2] = rows[3] + rows[axis];
+		frustum.planes[axis * 2 + 1] = rows[3] - rows[axis];
+	}
+	for(glm::vec4 &plane : frustum.planes)
+		plane /= std::sqrt(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+	return frustum;
+}
+
+void BoxList::clear()
+{
+	minX.clear();
+	minY.clear();
+	minZ.clear();
+	maxX.clear();
+	maxY.clear();
+	maxZ.clear();
+}
+
+void BoxList::add(float x0, float y0, float z0, float x1, float y1, float z1)
+{
+	minX.push_back(x0);
+	minY.push_back(y0);
+	minZ.push_back(z0);
+	maxX.push_back(x1);
+	maxY.push_back(y1);
+	maxZ.push_back(z1);
+}
+
+int cullBoxes(const Frustum &frustum, const BoxList &boxes, uint8_t *visible)
+{
+	// The corner farthest along a plane's normal takes the max bound on every
+	// axis the normal points up and the min bound on the others, the same for
+	// every box, so each plane picks its three arrays once.
+	const float *corner[6][3];
+	for(int p = 0; p < 6; p++)
+	{
+		const glm::vec4 &plane = frustum.planes[p];
+		corner[p][0] = plane.x >= 0.0f ? boxes.maxX.data() : boxes.minX.data();
+		corner[p][1] = plane.y >= 0.0f ? boxes.maxY.data() : boxes.minY.data();
+		corner[p][2] = plane.z >= 0.0f ? boxes.maxZ.data() : boxes.minZ.data();
+	}
+
+	const size_t count = boxes.size();
+	size_t i = 0;
+	int visibleCount = 0;
+#if defined(__AVX__)
+	for(; i + 8 <= count; i += 8)
+	{
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for(int p = 0; p < 6; p++)
+		{
+			const glm::vec4 &plane = frustum.planes[p];
+			__m256 distance = _mm256_add_ps(
+				_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.x), _mm256_loadu_ps(corner[p][0] + i)),
+					_mm256_mul_ps(_mm256_set1_ps(plane.y), _mm256_loadu_ps(corner[p][1] + i))),
+				_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.z), _mm256_loadu_ps(corner[p][2] + i)),
+					_mm256_set1_ps(plane.w)));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_GE_OQ));
+		}
+		int mask = _mm256_movemask_ps(inside);
+		for(int k = 0; k < 8; k++)
+			visible[i + k] = (mask >> k) & 1;
+		visibleCount += __builtin_popcount(mask);
+	}
+#endif
+#if defined(__SSE__)
+	for(; i + 4 <= count; i += 4)
+	{
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for(int p = 0; p < 6; p++)
+		{
+			const glm::vec4 &plane = frustum.planes[p];
+			__m128 distance = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), _mm_loadu_ps(corner[p][0] + i)),
+					_mm_mul_ps(_mm_set1_ps(plane.y), _mm_loadu_ps(corner[p][1] + i))),
+				_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.z), _mm_loadu_ps(corner[p][2] + i)),
+					_mm_set1_ps(plane.w)));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, _mm_setzero_ps()));
+		}
+		int mask = _mm_movemask_ps(inside);
+		for(int k = 0; k < 4; k++)
+			visible[i + k] = (mask >> k) & 1;
+		visibleCount += __builtin_popcount(mask);
+	}
+#endif
+	for(; i < count; i++)
+	{
+		bool inside = true;
+		for(int p = 0; p < 6 && inside; p++)
+		{
+			const glm::vec4 &plane = frustum.planes[p];
+			inside = plane.x * corner[p][0][i] + plane.y * corner[p][1][i] + plane.z * corner[p][2][i] + plane.w >= 0.0f;
+		}
+		visible[i] = inside;
+		visibleCount += inside;
+	}
+	return visibleCount;
+}
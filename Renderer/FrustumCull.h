@@ -0,0 +1,47 @@
+#ifndef FRUSTUMCULL_H
+#define FRUSTUMCULL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#ifndef MATRIX
+#define MATRIX
+
+#include "../glm/glm.hpp"
+#include "../glm/gtc/matrix_transform.hpp"
+#include "../glm/gtc/type_ptr.hpp"
+
+#endif
+
+// The six planes of a view frustum, a point p is inside a plane when
+// dot(plane.xyz, p) + plane.w >= 0. Normals are unit length.
+struct Frustum
+{
+	glm::vec4 planes[6];
+};
+
+// Planes of a projection * view (* model) matrix, in the space the matrix
+// maps from, so boxes can be tested in model space.
+Frustum extractFrustum(const glm::mat4 &viewProjection);
+
+// Axis aligned boxes as structure of arrays, so one SIMD load brings in the
+// same bound of 4 or 8 boxes.
+struct BoxList
+{
+	std::vector<float> minX, minY, minZ;
+	std::vector<float> maxX, maxY, maxZ;
+
+	size_t size() const { return minX.size(); }
+	void clear();
+	void add(float x0, float y0, float z0, float x1, float y1, float z1);
+};
+
+// Sets visible[i] to 1 for every box that may intersect the frustum and 0 for
+// the ones entirely outside one of its planes, returning the visible count.
+// Each plane is tested against the box corner farthest along its normal,
+// which is conservative for boxes near the frustum's edges and corners.
+// Runs 8 boxes at a time with AVX, 4 with SSE, when the build enables them.
+int cullBoxes(const Frustum &frustum, const BoxList &boxes, uint8_t *visible);
+
+#endif
@@ -0,0 +1,220 @@
+#include "MeshSimplifier.h"
+#include <algorithm>
+#include <cmath>
+#include <queue>
+
+namespace
+{
+	// Symmetric 4x4 plane quadric, the upper triangle row by row.
+	struct Quadric
+	{
+		double q[10] = {};
+
+		void addPlane(double a, double b, double c, double d)
+		{
+			double p[4] = { a, b, c, d };
+			int k = 0;
+			for(int i = 0; i < 4; i++)
+			{
+				for(int j = i; j < 4; j++)
+					q[k++] += p[i] * p[j];
+			}
+		}
+		void add(const Quadric &other)
+		{
+			for(int i = 0; i < 10; i++)
+				q[i] += other.q[i];
+		}
+		// Sum of squared distances of (x, y, z) to the planes.
+		double error(double x, double y, double z) const
+		{
+			return q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x
+				+ q[4] * y * y + 2 * q[5] * y * z + 2 * q[6] * y
+				+ q[7] * z * z + 2 * q[8] * z
+				+ q[9];
+		}
+	};
+
+	struct Collapse
+	{
+		double cost;
+		uint32_t from, to;
+		uint32_t stamp;
+		bool operator>(const Collapse &other) const { return cost > other.cost; }
+	};
+}
+
+void simplifyMesh(const float *positions, size_t vertexCount, const uint32_t *indices, size_t indexCount,
+	const std::vector<char> &locked, float maxError, std::vector<uint32_t> &out)
+{
+	const size_t triangleCount = indexCount / 3;
+	std::vector<uint32_t> triangles(indices, indices + triangleCount * 3);
+	std::vector<char> alive(triangleCount, 1);
+	std::vector<std::vector<uint32_t>> around(vertexCount);
+	std::vector<Quadric> quadrics(vertexCount);
+	auto position = [&](uint32_t v) { return positions + (size_t)v * 3; };
+
+	for(size_t t = 0; t < triangleCount; t++)
+	{
+		const uint32_t *c = &triangles[t * 3];
+		const float *p0 = position(c[0]), *p1 = position(c[1]), *p2 = position(c[2]);
+		double ux = p1[0] - p0[0], uy = p1[1] - p0[1], uz = p1[2] - p0[2];
+		double vx = p2[0] - p0[0], vy = p2[1] - p0[1], vz = p2[2] - p0[2];
+		double nx = uy * vz - uz * vy, ny = uz * vx - ux * vz, nz = ux * vy - uy * vx;
+		double length = std::sqrt(nx * nx + ny * ny + nz * nz);
+		for(int k = 0; k < 3; k++)
+			around[c[k]].push_back((uint32_t)t);
+		if(length == 0.0)
+			continue;
+		nx /= length;
+		ny /= length;
+		nz /= length;
+		Quadric plane;
+		plane.addPlane(nx, ny, nz, -(nx * p0[0] + ny * p0[1] + nz * p0[2]));
+		for(int k = 0; k < 3; k++)
+			quadrics[c[k]].add(plane);
+	}
+
+	auto signedArea = [&](uint32_t a, uint32_t b, uint32_t c) {
+		const float *p0 = position(a), *p1 = position(b), *p2 = position(c);
+		return (double)(p1[0] - p0[0]) * (p2[1] - p0[1]) - (double)(p1[1] - p0[1]) * (p2[0] - p0[0]);
+	};
+	// Moving `from` onto `to` must keep every surviving triangle around it
+	// non-degenerate and facing the same way in the xy plane.
+	auto valid = [&](uint32_t from, uint32_t to) {
+		for(uint32_t t : around[from])
+		{
+			const uint32_t *c = &triangles[(size_t)t * 3];
+			if(c[0] == to || c[1] == to || c[2] == to)
+				continue;
+			uint32_t moved[3];
+			for(int k = 0; k < 3; k++)
+				moved[k] = c[k] == from ? to : c[k];
+			double before = signedArea(c[0], c[1], c[2]), after = signedArea(moved[0], moved[1], moved[2]);
+			if(after == 0.0 || (before > 0.0) != (after > 0.0))
+				return false;
+		}
+		return true;
+	};
+
+	const double limit = (double)maxError * maxError;
+	std::vector<uint32_t> stamps(vertexCount, 0);
+	std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> queue;
+	std::vector<uint32_t> ring;
+	auto neighbours = [&](uint32_t v) {
+		ring.clear();
+		for(uint32_t t : around[v])
+		{
+			for(int k = 0; k < 3; k++)
+			{
+				uint32_t w = triangles[(size_t)t * 3 + k];
+				if(w != v && std::find(ring.begin(), ring.end(), w) == ring.end())
+					ring.push_back(w);
+			}
+		}
+	};
+	// Queues the cheapest valid collapse of `from`, if it is within the limit.
+	auto consider = [&](uint32_t from) {
+		stamps[from]++;
+		if(locked[from] || around[from].empty())
+			return;
+		neighbours(from);
+		Collapse best = { limit, from, from, stamps[from] };
+		bool found = false;
+		for(uint32_t to : ring)
+		{
+			Quadric merged = quadrics[from];
+			merged.add(quadrics[to]);
+			const float *p = position(to);
+			double cost = std::max(merged.error(p[0], p[1], p[2]), 0.0);
+			if(cost <= best.cost && valid(from, to))
+			{
+				best.cost = cost;
+				best.to = to;
+				found = true;
+			}
+		}
+		if(found)
+			queue.push(best);
+	};
+	for(uint32_t v = 0; v < vertexCount; v++)
+		consider(v);
+
+	std::vector<uint32_t> affected;
+	while(!queue.empty())
+	{
+		Collapse collapse = queue.top();
+		queue.pop();
+		uint32_t from = collapse.from, to = collapse.to;
+		if(collapse.stamp != stamps[from] || around[from].empty())
+			continue;
+		// Collapses into a vertex whose quadric grew since are queued too cheap,
+		// and ones next to a collapse may have become invalid.
+		Quadric merged = quadrics[from];
+		merged.add(quadrics[to]);
+		const float *p = position(to);
+		if(merged.error(p[0], p[1], p[2]) > collapse.cost * (1.0 + 1e-9) + 1e-18 || !valid(from, to))
+		{
+			consider(from);
+			continue;
+		}
+
+		neighbours(from);
+		affected = ring;
+		for(uint32_t t : around[from])
+		{
+			uint32_t *c = &triangles[(size_t)t * 3];
+			if(c[0] == to || c[1] == to || c[2] == to)
+			{
+				// The triangles on the collapsed edge disappear.
+				alive[t] = 0;
+				for(int k = 0; k < 3; k++)
+				{
+					if(c[k] != from)
+					{
+						std::vector<uint32_t> &list = around[c[k]];
+						list.erase(std::find(list.begin(), list.end(), t));
+					}
+				}
+				continue;
+			}
+			for(int k = 0; k < 3; k++)
+			{
+				if(c[k] == from)
+					c[k] = to;
+			}
+			around[to].push_back(t);
+		}
+		around[from].clear();
+		quadrics[to].add(quadrics[from]);
+		for(uint32_t v : affected)
+			consider(v);
+	}
+
+	out.clear();
+	for(size_t t = 0; t < triangleCount; t++)
+	{
+		if(alive[t])
+			out.insert(out.end(), &triangles[t * 3], &triangles[t * 3] + 3);
+	}
+}
+
+void simplifyGridChunk(const HeightMap &heights, float cellSize, const std::vector<uint32_t> &indices,
+	float maxError, std::vector<uint32_t> &out)
+{
+	const int width = heights.width, height = heights.height;
+	std::vector<float> positions((size_t)width * height * 3);
+	std::vector<char> locked((size_t)width * height);
+	for(int y = 0; y < height; y++)
+	{
+		for(int x = 0; x < width; x++)
+		{
+			size_t i = (size_t)y * width + x;
+			positions[i * 3] = x * cellSize;
+			positions[i * 3 + 1] = y * cellSize;
+			positions[i * 3 + 2] = heights.at(x, y);
+			locked[i] = x == 0 || y == 0 || x == width - 1 || y == height - 1;
+		}
+	}
+	simplifyMesh(positions.data(), (size_t)width * height, indices.data(), indices.size(), locked, maxError, out);
+}
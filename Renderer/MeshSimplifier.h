@@ -0,0 +1,28 @@
+#ifndef MESHSIMPLIFIER_H
+#define MESHSIMPLIFIER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "../TerrainGenerator/HeightMap.h"
+
+// Quadric error simplification of a heightfield triangle list by half-edge
+// collapses: a vertex is merged into one of its neighbours, so no vertex is
+// moved or created and the result is only a new index list over the same
+// vertices, which can stay where they are on the GPU. Collapses are taken
+// cheapest first by the summed plane quadrics of the merged vertices until
+// the next one would move the surface by more than `maxError` (a distance,
+// in the units of `positions`). Collapses that would fold a triangle over
+// in the xy plane are skipped, and vertices with `locked` set never move.
+//
+// `positions` holds x, y, z per vertex. Triangles keep their own winding.
+void simplifyMesh(const float *positions, size_t vertexCount, const uint32_t *indices, size_t indexCount,
+	const std::vector<char> &locked, float maxError, std::vector<uint32_t> &out);
+
+// simplifyMesh over the vertices of a chunk, one per sample of `heights` at
+// cellSize spacing, with the chunk border locked so the edges still match
+// the neighbours exactly.
+void simplifyGridChunk(const HeightMap &heights, float cellSize, const std::vector<uint32_t> &indices,
+	float maxError, std::vector<uint32_t> &out);
+
+#endif
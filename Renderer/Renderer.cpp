@@ -1,4 +1,9 @@
 #include "Renderer.h"
+#include "ChunkedTerrain.h"
+#include "DisplacedTerrain.h"
+#include "StreamBuffer.h"
+#include <algorithm>
+#include <cmath>
 #include "../TextureLoader/TextureLoader.cpp"
 
 Renderer::Renderer(int window_width, int window_height) {
@@ -6,9 +11,9 @@ Renderer::Renderer(int window_width, int window_height) {
     WINDOW_HEIGHT = window_height;
 
 
-    /* Set OpenGL versions [1, 3] */
+    /* Set OpenGL versions [3, 3], chunk draws need base vertices (3.2) */
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 1);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
 
     const std::string title = "Project Exper";
@@ -83,39 +88,53 @@ void Renderer::handle_input() {
 			SDL_Keycode w = event.key.keysym.sym;
 			if(w == 119) {
 				wireframe = !wireframe;
+			} else if(w == 103) {
+				displaced = !displaced;
+			} else if(w == 118) {
+				packedVertices = !packedVertices;
+			} else if(w == 100) {
+				debug_mode = !debug_mode;
+			} else if(w == 98) {
+				raiseTerrain = true;
+			} else if(w == 110) {
+				lowerTerrain = true;
 			}
-		}
-	}
-}
-
-std::vector<Vertex3D> generateTerrain(double zOffset, TerrainGenerator gen)
-{
-	std::vector<Vertex3D> vertexVector;
-	std::vector<std::vector<TerrainQuad>> terrain = gen.Generate(100, 100, 1.0, zOffset);
-	std::array<int, 6> cornerIndices = { { 0, 1, 2, 0, 3, 2 } };
-	double size = terrain[0][0].size;
-	for(int row = 0; row < terrain.size() - 1; row++)
-	{
-		for(int i = 0; i < terrain[row].size(); i++)
-		{
-			std::array<std::array<double, 3>, 4> corners = {{
-				{ terrain[row][i].x, terrain[row][i].y, terrain[row][i].elevations[0] },
-				{ terrain[row][i].x, terrain[row + 1][i].y, terrain[row + 1][i].elevations[0] },
-				{ terrain[row][i].x + size, terrain[row + 1][i].y, terrain[row + 1][i].elevations[3] },
-				{ terrain[row][i].x + size, terrain[row][i].y, terrain[row][i].elevations[3] }
-			}};
-			for(int vertexIndex = 0; vertexIndex < cornerIndices.size(); vertexIndex++)
-			{
-				std::array<double, 3> corner = corners[cornerIndices[vertexIndex]];
-				// std::cout << "Corner: " << corner[0] << ", " << corner[1] << ", " << corner[2] << std::endl;
-				vertexVector.push_back({ corner[0], corner[1], corner[2] });
+		} else if(event.type == SDL_KEYUP) {
+			SDL_Keycode w = event.key.keysym.sym;
+			if(w == 98 || w == 110) {
+				brushReleased = true;
 			}
 		}
 	}
-
-	return vertexVector;
 }
 
+// Noise units of Generate's zOffset per heightmap sample, the generator's sample spacing.
+const double NOISE_UNITS_PER_SAMPLE = 0.02;
+const int VIEW_CHUNKS_X = (VIEW_ROWS + CHUNK_QUADS - 1) / CHUNK_QUADS;
+// A window that does not start on a chunk edge touches one more chunk row.
+const int TERRAIN_SLOTS = VIEW_CHUNKS_X * (VIEW_CHUNKS_X + 1);
+// Column of the terrain the camera looks along.
+const float CAMERA_X = 50.0f;
+// Distance from the camera, in samples, where chunks switch to LOD 1; each
+// doubling of it drops one more LOD.
+const float LOD_DISTANCE = 40.0f;
+// Chunks this far from the camera are simplified to within SIMPLIFY_ERROR of
+// the terrain, in height units.
+const float SIMPLIFY_DISTANCE = 60.0f;
+const float SIMPLIFY_ERROR = 0.002f;
+// Brush dabs land this many rows ahead of the window's first row, under the camera's column.
+const float BRUSH_AHEAD = 20.0f;
+const float BRUSH_RADIUS = 6.0f;
+const float BRUSH_STRENGTH = 0.05f;
+// A stroke also ends after this many frames without dabs, e.g. when the key
+// release was missed.
+const int STROKE_IDLE_FRAMES = 30;
+// Staging per frame in flight, enough to reload a full window of chunks in
+// the larger vertex format, or every row of the displaced grid.
+const size_t STREAM_REGION_BYTES = std::max(
+	TERRAIN_SLOTS * StreamBuffer::allocationSize((CHUNK_QUADS + 1) * (CHUNK_QUADS + 1) * sizeof(Vertex3D)),
+	StreamBuffer::allocationSize((VIEW_ROWS + 1) * (VIEW_ROWS + 1) * sizeof(float)));
+
 void Renderer::render(TerrainGenerator gen) {
     if(error) {
         Show_Error("Unknown error!");
@@ -123,37 +142,24 @@ void Renderer::render(TerrainGenerator gen) {
     }
 
 	double z = 0.0f;
-	std::vector<Vertex3D> vertexVector = generateTerrain(z, gen);
-
-	std::cout << vertexVector[0].x << std::endl;
-
-	GLfloat vertices[vertexVector.size() * 3];
-	for(int i = 0; i < vertexVector.size(); i++)
-	{
-		int glIndex = i * 3;
-		// std::cout << "X: " << vertexVector[i].x << " Y: " << vertexVector[i].y << " Z: " << vertexVector[i].z << std::endl;
-		vertices[glIndex] = vertexVector[i].x;
-		vertices[glIndex+1] = vertexVector[i].y;
-		vertices[glIndex+2] = vertexVector[i].z;
-	}
 
 	/* Set textures to fragment shader uniforms */
 	shader->use();
 
-    /* Create and initialize vertex buffer */
-    GLuint vertexBufferID, vertexArrayID;
-	GLuint EBO;
-
-	glGenVertexArrays(1, &vertexArrayID);
-	glBindVertexArray(vertexArrayID);
-
-    glGenBuffers(1, &vertexBufferID);
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-	// Position attributes.
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
+	GridIndexCache gridIndices;
+	StreamBuffer stream(STREAM_REGION_BYTES);
+	stream.create();
+	ChunkedTerrain terrain(CHUNK_QUADS, TERRAIN_SLOTS);
+	terrain.create(gridIndices, stream, shader->ID);
+	terrain.setSimplification(SIMPLIFY_DISTANCE, SIMPLIFY_ERROR);
+	// Same window as the chunks, plus the row the scroll is part way into.
+	DisplacedTerrain displacedTerrain(VIEW_ROWS, VIEW_ROWS + 1);
+	displacedTerrain.create(gridIndices, stream, shader->ID);
+	EditLayer edits;
+	// Frames since the open stroke's last dab, -1 when no stroke is open.
+	int strokeIdle = -1;
+	terrain.setEdits(&edits);
+	displacedTerrain.setEdits(&edits);
 
 	unsigned long long int time = 1;
 
@@ -163,20 +169,18 @@ void Renderer::render(TerrainGenerator gen) {
 
 
 	glm::mat4 view = glm::mat4(1.0f);
-	view = glm::translate(view, glm::vec3(-50.0f, -5.0f, z * 100));
+	view = glm::translate(view, glm::vec3(-CAMERA_X, -5.0f, z * 100));
 
 
 
 
-	glm::mat4 model = glm::mat4(1.0f);
-	model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-	model = glm::translate(model, glm::vec3(0, z * 100, 0));
+	glm::mat4 rotation = glm::mat4(1.0f);
+	rotation = glm::rotate(rotation, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
 
 	glm::mat4 projection;
 	projection = glm::perspective(glm::radians(45.0f), 640.0f / 480.0f, 0.1f, 100.0f);
 
 	int modelLoc = glGetUniformLocation(shader->ID, "model");
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
 
 
 	int viewLoc = glGetUniformLocation(shader->ID, "view");
@@ -186,31 +190,72 @@ void Renderer::render(TerrainGenerator gen) {
 	int projectionLoc = glGetUniformLocation(shader->ID, "projection");
 	glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
 
+	glUniform1i(glGetUniformLocation(shader->ID, "heights"), 0);
+	glUniform1f(glGetUniformLocation(shader->ID, "maxColumn"), (float)VIEW_ROWS);
+	glEnable(GL_CLIP_DISTANCE0);
+
 	glEnable(GL_DEPTH_TEST);
 	// running = false;
     while(running) {
         handle_input();
+		stream.beginFrame();
         /* MAIN RENDER HERE! */
 		shader->use();
 		/* Transformation */
 		/* Rotation and scaling */
 
-		std::vector<Vertex3D> vertexVector = generateTerrain(z, gen);
-		for(int i = 0; i < vertexVector.size(); i++)
-		{
-			int glIndex = i * 3;
-			// std::cout << "X: " << vertexVector[i].x << " Y: " << vertexVector[i].y << " Z: " << vertexVector[i].z << std::endl;
-			vertices[glIndex] = vertexVector[i].x;
-			vertices[glIndex+1] = vertexVector[i].y;
-			vertices[glIndex+2] = vertexVector[i].z;
+		// Both paths place their meshes relative to the window's first row
+		// and the scroll only moves the model, so new heights are generated
+		// and uploaded only when rows enter the window.
+		double scrollRow = z / NOISE_UNITS_PER_SAMPLE;
+		int originRow = (int)std::floor(scrollRow);
+		if(raiseTerrain || lowerTerrain) {
+			TerrainBrush brush;
+			brush.x = CAMERA_X;
+			brush.y = (float)scrollRow + BRUSH_AHEAD;
+			brush.radius = BRUSH_RADIUS;
+			brush.strength = raiseTerrain ? BRUSH_STRENGTH : -BRUSH_STRENGTH;
+			brush.maxDelta = PACKED_EDIT_RANGE;
+			edits.applyBrush(brush);
+			raiseTerrain = lowerTerrain = false;
+			strokeIdle = 0;
+		} else if(strokeIdle >= 0) {
+			strokeIdle++;
+		}
+		// Packing the stroke's tiles once it ends keeps repeated dabs from
+		// requantizing them, and marking them dirty, over and over.
+		if(strokeIdle >= 0 && (brushReleased || strokeIdle >= STROKE_IDLE_FRAMES)) {
+			edits.endStroke();
+			strokeIdle = -1;
+		}
+		brushReleased = false;
+		// Edits only rewrite the rows they touched, in both paths' resident data.
+		for(const DirtyRect &rect : edits.takeDirty()) {
+			terrain.applyEdits(gen, rect);
+			displacedTerrain.applyEdits(gen, rect);
+		}
+		if(displaced) {
+			displacedTerrain.update(gen, originRow);
+		} else {
+			int firstChunk = (int)std::floor(scrollRow / CHUNK_QUADS);
+			int lastChunk = (int)std::floor((scrollRow + VIEW_ROWS) / CHUNK_QUADS);
+			terrain.setFormat(packedVertices ? CHUNK_VERTEX_PACKED : CHUNK_VERTEX_FLOAT);
+			terrain.update(gen, 0, firstChunk, VIEW_CHUNKS_X, lastChunk + 1);
+			terrain.selectLods(CAMERA_X, (float)scrollRow, LOD_DISTANCE);
 		}
 
+		glm::mat4 model = glm::translate(rotation, glm::vec3(0.0f, (float)(originRow - scrollRow), 0.0f));
+		glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
 
-	    glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
-	    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-
-		glBindVertexArray(vertexArrayID);
+		if(!displaced) {
+			CullStats culling = terrain.cull(projection * view * model, originRow);
+			if(debug_mode) {
+				std::cout << "Chunks visible: " << culling.visible << " culled: " << culling.culled << std::endl;
+				ChunkPoolStats pool = edits.poolStats();
+				std::cout << "Edit tiles: " << edits.tileCount() << " pool reused: " << pool.reused << " of " << pool.acquired
+					<< " allocated: " << pool.systemAllocations << std::endl;
+			}
+		}
 
 		if(wireframe) {
 			glPolygonMode( GL_FRONT_AND_BACK, GL_LINE );
@@ -218,8 +263,13 @@ void Renderer::render(TerrainGenerator gen) {
 
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		glDrawArrays(GL_TRIANGLES, 0, vertexVector.size());
+		if(displaced) {
+			displacedTerrain.draw(0, originRow);
+		} else {
+			terrain.draw(originRow);
+		}
 		glPolygonMode( GL_FRONT_AND_BACK, GL_FILL );
+		stream.endFrame();
 
         SDL_GL_SwapWindow(render_window);
 		time += 1;
@@ -227,6 +277,10 @@ void Renderer::render(TerrainGenerator gen) {
     }
 
     glUseProgram(NULL);
+	terrain.destroy();
+	displacedTerrain.destroy();
+	stream.destroy();
+	gridIndices.clear();
 
     SDL_GL_DeleteContext(render_context);
     SDL_DestroyWindow(render_window);
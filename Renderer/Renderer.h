@@ -43,6 +43,12 @@ struct TexturedVertex3D {
 	float x, y, z, t, s;
 };
 
+// Quads along each side of a terrain chunk.
+const int CHUNK_QUADS = 32;
+// Rows of terrain visible ahead of the camera, also the window's width in
+// columns. Whole chunks cover it, the columns past it are clipped.
+const int VIEW_ROWS = 100;
+
 class Renderer {
 private:
 	unsigned int WINDOW_WIDTH, WINDOW_HEIGHT;
@@ -52,7 +58,13 @@ private:
 	bool error = false;
 	bool running = true;
 	bool wireframe = false;
+	bool displaced = false;
+	bool packedVertices = true;
 	bool debug_mode = false;
+	// Brush dabs asked for since the last frame, and whether a brush key was let go.
+	bool raiseTerrain = false;
+	bool lowerTerrain = false;
+	bool brushReleased = false;
 	std::string load_shader(const char *filename);
 	void Show_Error(std::string error_message);
 	void setTexture(GLuint &texture, std::string filename, bool isAlpha, bool flipped);
@@ -0,0 +1,112 @@
+#include "StreamBuffer.h"
+#include <iostream>
+
+StreamBuffer::StreamBuffer(size_t regionSize, int regions)
+	: regionSize(allocationSize(regionSize)), fences(regions, nullptr)
+{
+}
+
+void StreamBuffer::create()
+{
+	const GLsizeiptr size = (GLsizeiptr)(regionSize * fences.size());
+	glGenBuffers(1, &bufferID);
+	glBindBuffer(GL_COPY_READ_BUFFER, bufferID);
+	if(GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage)
+	{
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_COPY_READ_BUFFER, size, nullptr, flags);
+		mapped = (char*)glMapBufferRange(GL_COPY_READ_BUFFER, 0, size, flags);
+		if(mapped == nullptr)
+			std::cout << "ERROR::STREAMBUFFER::PERSISTENT_MAP_FAILED" << std::endl;
+	}
+	if(mapped == nullptr)
+		glBufferData(GL_COPY_READ_BUFFER, size, nullptr, GL_STREAM_DRAW);
+	region = 0;
+	used = 0;
+}
+
+void StreamBuffer::destroy()
+{
+	for(GLsync &fence : fences)
+	{
+		if(fence)
+			glDeleteSync(fence);
+		fence = nullptr;
+	}
+	if(mapped || mapping)
+	{
+		glBindBuffer(GL_COPY_READ_BUFFER, bufferID);
+		glUnmapBuffer(GL_COPY_READ_BUFFER);
+	}
+	glDeleteBuffers(1, &bufferID);
+	bufferID = 0;
+	mapped = nullptr;
+	mapping = false;
+}
+
+void StreamBuffer::beginFrame()
+{
+	region = (region + 1) % fences.size();
+	used = 0;
+	orphaned = false;
+	GLsync &fence = fences[region];
+	if(fence == nullptr)
+		return;
+	// Usually long signalled, the GL is at most fences.size() - 1 frames behind.
+	while(true)
+	{
+		GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+		if(result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED)
+			break;
+		if(result == GL_WAIT_FAILED)
+		{
+			std::cout << "ERROR::STREAMBUFFER::WAIT_FAILED" << std::endl;
+			break;
+		}
+	}
+	glDeleteSync(fence);
+	fence = nullptr;
+}
+
+void StreamBuffer::endFrame()
+{
+	unmap();
+	// Orphaned storage is never reused while the GL reads it, only the
+	// persistent mapping needs the fence.
+	if(used > 0 && mapped)
+		fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void *StreamBuffer::map(size_t size, GLintptr &offset)
+{
+	unmap();
+	if(size > regionSize - used)
+		return nullptr;
+	offset = (GLintptr)(region * regionSize + used);
+	used += allocationSize(size);
+	if(used > regionSize)
+		used = regionSize;
+	if(mapped)
+		return mapped + offset;
+
+	// Fresh storage on the first upload of a frame, after which the ranges
+	// handed out never overlap and can be mapped without synchronizing.
+	glBindBuffer(GL_COPY_READ_BUFFER, bufferID);
+	if(!orphaned)
+	{
+		glBufferData(GL_COPY_READ_BUFFER, (GLsizeiptr)(regionSize * fences.size()), nullptr, GL_STREAM_DRAW);
+		orphaned = true;
+	}
+	mapping = true;
+	return glMapBufferRange(GL_COPY_READ_BUFFER, offset, (GLsizeiptr)size,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+}
+
+void StreamBuffer::unmap()
+{
+	if(!mapping)
+		return;
+	glBindBuffer(GL_COPY_READ_BUFFER, bufferID);
+	glUnmapBuffer(GL_COPY_READ_BUFFER);
+	mapping = false;
+}
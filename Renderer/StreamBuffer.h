@@ -0,0 +1,66 @@
+#ifndef STREAMBUFFER_H
+#define STREAMBUFFER_H
+
+#ifndef GL
+#define GL
+
+#include <SDL2/SDL.h>
+#include <GL/glew.h>
+
+#endif
+
+#include <cstddef>
+#include <vector>
+
+// Staging memory for uploads, written by the CPU and then copied by the GL
+// into buffers (glCopyBufferSubData) or textures (as the pixel unpack
+// buffer). The buffer is split into one region per frame in flight, each
+// guarded by a fence, so a region is only written again once the GL has
+// finished reading it and writes never wait on the driver.
+//
+// With ARB_buffer_storage the whole buffer stays mapped persistently and
+// coherently, writing into it costs a memcpy. Without it every frame that
+// uploads orphans the buffer and maps each allocation unsynchronized, and
+// unmap() must be called before the GL reads it.
+class StreamBuffer
+{
+public:
+	StreamBuffer(size_t regionSize, int regions = 3);
+
+	// Region space map(size) takes up, allocations start on GL_MIN_MAP_BUFFER_ALIGNMENT,
+	// which is at least 64.
+	static constexpr size_t allocationSize(size_t size) { return (size + 63) & ~(size_t)63; }
+
+	// Creates and maps the buffer, needs a current GL context.
+	void create();
+	// Unmaps and deletes it, must run while the context is still current.
+	void destroy();
+
+	// Moves to the next region, waiting for its fence if the GL is still
+	// reading it. Call once at the start of every frame.
+	void beginFrame();
+	// Fences the current region if anything was written to it.
+	void endFrame();
+
+	// Room for `size` bytes in the current region, or nullptr when the region
+	// is full and the caller should upload some other way. `offset` is where
+	// the bytes start in buffer().
+	void *map(size_t size, GLintptr &offset);
+	// Hands the last mapping over to the GL, a no-op when persistently mapped.
+	void unmap();
+
+	GLuint buffer() const { return bufferID; }
+	bool persistent() const { return mapped != nullptr; }
+
+private:
+	size_t regionSize;
+	std::vector<GLsync> fences;
+	int region = 0;
+	size_t used = 0;
+
+	GLuint bufferID = 0;
+	char *mapped = nullptr;
+	bool orphaned = false, mapping = false;
+};
+
+#endif
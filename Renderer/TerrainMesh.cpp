@@ -0,0 +1,176 @@
+#include "TerrainMesh.h"
+#include "VertexCache.h"
+#include <algorithm>
+
+void buildGridVertices(const HeightMap &heights, float cellSize, std::vector<Vertex3D> &vertices, float originX, float originY)
+{
+	vertices.resize((size_t)heights.width * heights.height);
+	buildGridVertices(heights, cellSize, vertices.data(), originX, originY);
+}
+
+void buildGridVertices(const HeightMap &heights, float cellSize, Vertex3D *out, float originX, float originY)
+{
+	buildGridVertices(heights, cellSize, 0, heights.height, out, originX, originY);
+}
+
+void buildGridVertices(const HeightMap &heights, float cellSize, int firstRow, int lastRow, Vertex3D *out,
+	float originX, float originY)
+{
+	for(int y = firstRow; y < lastRow; y++, out += heights.width)
+	{
+		const float *row = heights.row(y);
+		for(int x = 0; x < heights.width; x++)
+			out[x] = { originX + x * cellSize, originY + y * cellSize, row[x] };
+	}
+}
+
+void buildGridIndices(int quadsX, int quadsY, std::vector<uint32_t> &indices)
+{
+	indices.clear();
+	indices.reserve((size_t)quadsX * quadsY * 6);
+	const uint32_t stride = quadsX + 1;
+	for(int y = 0; y < quadsY; y++)
+	{
+		for(int x = 0; x < quadsX; x++)
+		{
+			uint32_t topLeft = y * stride + x;
+			uint32_t corners[4] = { topLeft, topLeft + stride, topLeft + stride + 1, topLeft + 1 };
+			uint32_t quad[6] = { corners[0], corners[1], corners[2], corners[0], corners[3], corners[2] };
+			indices.insert(indices.end(), quad, quad + 6);
+		}
+	}
+}
+
+void buildStitchedGridIndices(int quads, int lod, int coarserEdges, std::vector<uint32_t> &indices)
+{
+	indices.clear();
+	const int step = 1 << lod, stride = quads + 1;
+	// The coarsest LOD has no coarser neighbour to match.
+	if(step >= quads)
+		coarserEdges = 0;
+	auto vertex = [&](int x, int y) {
+		if(((coarserEdges & EDGE_MIN_X) && x == 0) || ((coarserEdges & EDGE_MAX_X) && x == quads))
+			y -= y & step;
+		if(((coarserEdges & EDGE_MIN_Y) && y == 0) || ((coarserEdges & EDGE_MAX_Y) && y == quads))
+			x -= x & step;
+		return (uint32_t)(y * stride + x);
+	};
+	for(int y = 0; y < quads; y += step)
+	{
+		for(int x = 0; x < quads; x += step)
+		{
+			uint32_t corners[4] = { vertex(x, y), vertex(x, y + step), vertex(x + step, y + step), vertex(x + step, y) };
+			uint32_t triangles[2][3] = { { corners[0], corners[1], corners[2] }, { corners[0], corners[3], corners[2] } };
+			for(auto &triangle : triangles)
+			{
+				if(triangle[0] != triangle[1] && triangle[1] != triangle[2] && triangle[0] != triangle[2])
+					indices.insert(indices.end(), triangle, triangle + 3);
+			}
+		}
+	}
+}
+
+const GridIndices &GridIndexCache::get(int quadsX, int quadsY)
+{
+	auto found = grids.find(std::make_pair(quadsX, quadsY));
+	if(found != grids.end())
+		return found->second;
+
+	std::vector<uint32_t> indices;
+	buildGridIndices(quadsX, quadsY, indices);
+	optimizeVertexCache(indices.data(), indices.size(), (size_t)(quadsX + 1) * (quadsY + 1));
+	GridIndices grid;
+	grid.count = indices.size();
+	glGenBuffers(1, &grid.buffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, grid.buffer);
+	if((size_t)(quadsX + 1) * (quadsY + 1) <= 65536)
+	{
+		std::vector<uint16_t> narrow(indices.begin(), indices.end());
+		grid.type = GL_UNSIGNED_SHORT;
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, narrow.size() * sizeof(uint16_t), narrow.data(), GL_STATIC_DRAW);
+	}
+	else
+	{
+		grid.type = GL_UNSIGNED_INT;
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.data(), GL_STATIC_DRAW);
+	}
+	return grids[std::make_pair(quadsX, quadsY)] = grid;
+}
+
+const StitchedGridIndices &GridIndexCache::getStitched(int quads)
+{
+	auto found = stitched.find(quads);
+	if(found != stitched.end())
+		return found->second;
+
+	StitchedGridIndices grid;
+	grid.lods = 1;
+	while((quads >> grid.lods) > 0 && (quads & ((1 << grid.lods) - 1)) == 0)
+		grid.lods++;
+	std::vector<uint32_t> all, indices;
+	for(int lod = 0; lod < grid.lods; lod++)
+	{
+		for(int mask = 0; mask < GRID_EDGE_MASKS; mask++)
+		{
+			buildStitchedGridIndices(quads, lod, mask, indices);
+			optimizeVertexCache(indices.data(), indices.size(), (size_t)(quads + 1) * (quads + 1));
+			grid.offsets.push_back(all.size());
+			grid.counts.push_back(indices.size());
+			all.insert(all.end(), indices.begin(), indices.end());
+		}
+	}
+	glGenBuffers(1, &grid.buffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, grid.buffer);
+	size_t indexSize = sizeof(uint32_t);
+	if((size_t)(quads + 1) * (quads + 1) <= 65536)
+	{
+		std::vector<uint16_t> narrow(all.begin(), all.end());
+		grid.type = GL_UNSIGNED_SHORT;
+		indexSize = sizeof(uint16_t);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, narrow.size() * indexSize, narrow.data(), GL_STATIC_DRAW);
+	}
+	else
+	{
+		grid.type = GL_UNSIGNED_INT;
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, all.size() * indexSize, all.data(), GL_STATIC_DRAW);
+	}
+	for(size_t &offset : grid.offsets)
+		offset *= indexSize;
+	return stitched[quads] = grid;
+}
+
+void GridIndexCache::clear()
+{
+	for(auto &entry : grids)
+		glDeleteBuffers(1, &entry.second.buffer);
+	grids.clear();
+	for(auto &entry : stitched)
+		glDeleteBuffers(1, &entry.second.buffer);
+	stitched.clear();
+}
+
+void packGridHeights(const HeightMap &heights, uint16_t *out)
+{
+	packGridHeights(heights.heights.data(), (size_t)heights.width * heights.height, out);
+}
+
+void packGridHeights(const float *heights, size_t count, uint16_t *out)
+{
+	const float scale = 65535.0f / (PACKED_HEIGHT_MAX - PACKED_HEIGHT_MIN);
+	for(size_t i = 0; i < count; i++)
+	{
+		float h = std::min(std::max((heights[i] - PACKED_HEIGHT_MIN) * scale, 0.0f), 65535.0f);
+		out[i] = (uint16_t)(h + 0.5f);
+	}
+}
+
+void TerrainUniforms::locate(GLuint program)
+{
+	vertexMode = glGetUniformLocation(program, "vertexMode");
+	gridWidth = glGetUniformLocation(program, "gridWidth");
+	gridVertices = glGetUniformLocation(program, "gridVertices");
+	chunkOrigin = glGetUniformLocation(program, "chunkOrigin");
+	heightMin = glGetUniformLocation(program, "heightMin");
+	heightMax = glGetUniformLocation(program, "heightMax");
+	firstRow = glGetUniformLocation(program, "firstRow");
+}
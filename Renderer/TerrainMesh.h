@@ -0,0 +1,130 @@
+#ifndef TERRAINMESH_H
+#define TERRAINMESH_H
+
+#ifndef GL
+#define GL
+
+#include <SDL2/SDL.h>
+#include <GL/glew.h>
+
+#endif
+
+#include <cstdint>
+#include <map>
+#include <utility>
+#include <vector>
+#include "Renderer.h"
+#include "../TerrainGenerator/HeightMap.h"
+
+// One vertex per heightmap sample: x and y on the grid offset by the
+// origin, z the height.
+void buildGridVertices(const HeightMap &heights, float cellSize, std::vector<Vertex3D> &vertices,
+	float originX = 0.0f, float originY = 0.0f);
+// Same into width * height vertices at `out`, e.g. mapped buffer memory.
+void buildGridVertices(const HeightMap &heights, float cellSize, Vertex3D *out, float originX, float originY);
+// Only rows [firstRow, lastRow), the first of them written at `out`.
+void buildGridVertices(const HeightMap &heights, float cellSize, int firstRow, int lastRow, Vertex3D *out,
+	float originX, float originY);
+
+// Generated heights lie in [0, 1], the noise range, and edits move them by at
+// most PACKED_EDIT_RANGE either way (TerrainBrush::maxDelta). Packed heights
+// are 16-bit fractions of that fixed range, so a sample shared by two chunks
+// always packs the same and their edges stay watertight.
+const float PACKED_EDIT_RANGE = 1.0f;
+const float PACKED_HEIGHT_MIN = -PACKED_EDIT_RANGE;
+const float PACKED_HEIGHT_MAX = 1.0f + PACKED_EDIT_RANGE;
+
+// One 16-bit height per heightmap sample, row-major.
+void packGridHeights(const HeightMap &heights, uint16_t *out);
+// Same for `count` heights, e.g. a run of rows.
+void packGridHeights(const float *heights, size_t count, uint16_t *out);
+
+// Two triangles per quad of a (quadsX + 1) x (quadsY + 1) vertex grid, in
+// the same corner order the unindexed mesh used.
+void buildGridIndices(int quadsX, int quadsY, std::vector<uint32_t> &indices);
+
+// Edges of a chunk grid, the bits of a stitching mask.
+enum GridEdge
+{
+	EDGE_MIN_X = 1,
+	EDGE_MAX_X = 2,
+	EDGE_MIN_Y = 4,
+	EDGE_MAX_Y = 8,
+	GRID_EDGE_MASKS = 16
+};
+
+// Triangles of the same grid at `lod`, using every (1 << lod)th vertex, with
+// the edges in `coarserEdges` matched to a neighbour one LOD coarser: their
+// odd vertices are snapped onto the previous even one and the triangles that
+// collapse are dropped, which leaves exactly the neighbour's edge and no
+// T-junctions. quads must be a multiple of 1 << lod.
+void buildStitchedGridIndices(int quads, int lod, int coarserEdges, std::vector<uint32_t> &indices);
+
+// Element buffer of one grid size, 16-bit whenever the vertices fit.
+struct GridIndices
+{
+	GLuint buffer = 0;
+	GLenum type = GL_UNSIGNED_INT;
+	GLsizei count = 0;
+};
+
+// Every LOD and stitching mask of a quads x quads grid in one element buffer,
+// so switching a chunk's LOD only changes the range it draws.
+struct StitchedGridIndices
+{
+	GLuint buffer = 0;
+	GLenum type = GL_UNSIGNED_INT;
+	int lods = 0;
+	std::vector<GLsizei> counts;
+	std::vector<size_t> offsets;
+
+	GLsizei count(int lod, int mask) const { return counts[lod * GRID_EDGE_MASKS + mask]; }
+	// Byte offset into the buffer, as glDrawElements takes it.
+	const void *offset(int lod, int mask) const { return (const void*)offsets[lod * GRID_EDGE_MASKS + mask]; }
+};
+
+// Index buffers depend only on the grid size, so every mesh of that size
+// shares one, built, reordered for the vertex cache and uploaded the first
+// time it is asked for.
+class GridIndexCache
+{
+public:
+	// Uploading binds GL_ELEMENT_ARRAY_BUFFER, which is part of the bound VAO.
+	const GridIndices &get(int quadsX, int quadsY);
+	// LODs go down to one quad or until quads is no longer even.
+	const StitchedGridIndices &getStitched(int quads);
+	// Deletes the buffers, must run while the GL context is still current.
+	void clear();
+
+private:
+	std::map<std::pair<int, int>, GridIndices> grids;
+	std::map<int, StitchedGridIndices> stitched;
+};
+
+// Locations of the terrain vertex shader uniforms the terrain paths set per
+// draw. Grid positions are relative to a chunk origin given in whole samples
+// from the window origin, so vertex coordinates stay small however far the
+// window has scrolled.
+struct TerrainUniforms
+{
+	GLint vertexMode = -1;
+	GLint gridWidth = -1, gridVertices = -1;
+	GLint chunkOrigin = -1;
+	GLint heightMin = -1, heightMax = -1;
+	GLint firstRow = -1;
+
+	void locate(GLuint program);
+};
+
+// Values of the `vertexMode` uniform.
+enum TerrainVertexMode
+{
+	// aPos holds the chunk-local position.
+	VERTEX_MODE_POSITION = 0,
+	// aHeight holds a packed height, x and y follow from gl_VertexID.
+	VERTEX_MODE_PACKED = 1,
+	// x and y from gl_VertexID, the height from the ring height texture.
+	VERTEX_MODE_DISPLACED = 2
+};
+
+#endif
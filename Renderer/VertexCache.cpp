@@ -0,0 +1,148 @@
+#include "VertexCache.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Vertex score from its position in the LRU cache and the triangles it still
+// has to be used by. The three most recent vertices share one score so the
+// triangle just emitted does not pull strips in one direction, and the
+// valence term finishes off vertices with few triangles left.
+static float forsythScore(int cachePosition, uint32_t remaining, int cacheSize)
+{
+	if(remaining == 0)
+		return -1.0f;
+	float score = 0.0f;
+	if(cachePosition >= 0)
+	{
+		if(cachePosition < 3)
+			score = 0.75f;
+		else
+			score = std::pow(1.0f - (float)(cachePosition - 3) / (cacheSize - 3), 1.5f);
+	}
+	return score + 2.0f / std::sqrt((float)remaining);
+}
+
+void optimizeVertexCache(uint32_t *indices, size_t indexCount, size_t vertexCount, int cacheSize)
+{
+	const size_t triangleCount = indexCount / 3;
+	if(triangleCount == 0 || cacheSize <= 3)
+		return;
+
+	// Triangles of every vertex, the first `remaining` of its range still to emit.
+	std::vector<uint32_t> offsets(vertexCount + 1, 0), remaining(vertexCount, 0);
+	for(size_t i = 0; i < indexCount; i++)
+		remaining[indices[i]]++;
+	for(size_t v = 0; v < vertexCount; v++)
+		offsets[v + 1] = offsets[v] + remaining[v];
+	std::vector<uint32_t> adjacency(indexCount), fill(offsets.begin(), offsets.end() - 1);
+	for(size_t i = 0; i < indexCount; i++)
+		adjacency[fill[indices[i]]++] = (uint32_t)(i / 3);
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> vertexScore(vertexCount);
+	for(size_t v = 0; v < vertexCount; v++)
+		vertexScore[v] = forsythScore(-1, remaining[v], cacheSize);
+	std::vector<float> triangleScore(triangleCount);
+	std::vector<char> emitted(triangleCount, 0);
+	size_t best = 0;
+	for(size_t t = 0; t < triangleCount; t++)
+	{
+		const uint32_t *corners = indices + t * 3;
+		triangleScore[t] = vertexScore[corners[0]] + vertexScore[corners[1]] + vertexScore[corners[2]];
+		if(triangleScore[t] > triangleScore[best])
+			best = t;
+	}
+
+	std::vector<uint32_t> output;
+	output.reserve(indexCount);
+	std::vector<uint32_t> cache, nextCache;
+	cache.reserve(cacheSize + 3);
+	nextCache.reserve(cacheSize + 3);
+	size_t scan = 0;
+	const size_t NONE = (size_t)-1;
+
+	for(size_t done = 0; done < triangleCount; done++)
+	{
+		if(best == NONE)
+		{
+			// Nothing left around the cache, continue with the next unused triangle.
+			while(emitted[scan])
+				scan++;
+			best = scan;
+		}
+		const uint32_t *corners = indices + best * 3;
+		output.insert(output.end(), corners, corners + 3);
+		emitted[best] = 1;
+
+		nextCache.assign(corners, corners + 3);
+		for(int k = 0; k < 3; k++)
+		{
+			uint32_t v = corners[k];
+			uint32_t *first = &adjacency[offsets[v]], *last = first + remaining[v];
+			*std::find(first, last, (uint32_t)best) = last[-1];
+			remaining[v]--;
+		}
+		for(uint32_t v : cache)
+		{
+			if(v != corners[0] && v != corners[1] && v != corners[2])
+				nextCache.push_back(v);
+		}
+
+		// Rescore the cached vertices, and the ones just pushed out, and every
+		// triangle around them; the best of those goes next.
+		for(size_t i = 0; i < nextCache.size(); i++)
+		{
+			uint32_t v = nextCache[i];
+			cachePosition[v] = i < (size_t)cacheSize ? (int)i : -1;
+			vertexScore[v] = forsythScore(cachePosition[v], remaining[v], cacheSize);
+		}
+		best = NONE;
+		float bestScore = 0.0f;
+		for(uint32_t v : nextCache)
+		{
+			for(uint32_t i = offsets[v], end = offsets[v] + remaining[v]; i < end; i++)
+			{
+				uint32_t t = adjacency[i];
+				const uint32_t *c = indices + (size_t)t * 3;
+				triangleScore[t] = vertexScore[c[0]] + vertexScore[c[1]] + vertexScore[c[2]];
+				if(best == NONE || triangleScore[t] > bestScore)
+				{
+					best = t;
+					bestScore = triangleScore[t];
+				}
+			}
+		}
+		if(nextCache.size() > (size_t)cacheSize)
+			nextCache.resize(cacheSize);
+		std::swap(cache, nextCache);
+	}
+	// Grids whose rows fit in the cache are already close to ideal in row
+	// order, which the greedy order does not always beat.
+	VertexCacheStats before = measureVertexCache(indices, indexCount, vertexCount, cacheSize);
+	VertexCacheStats after = measureVertexCache(output.data(), indexCount, vertexCount, cacheSize);
+	if(after.transforms < before.transforms)
+		std::copy(output.begin(), output.end(), indices);
+}
+
+VertexCacheStats measureVertexCache(const uint32_t *indices, size_t indexCount, size_t vertexCount, int cacheSize)
+{
+	VertexCacheStats stats;
+	// A vertex is still cached while fewer than cacheSize others were loaded
+	// after it.
+	std::vector<size_t> loadedAt(vertexCount, (size_t)-1);
+	size_t used = 0;
+	for(size_t i = 0; i < indexCount; i++)
+	{
+		uint32_t v = indices[i];
+		if(loadedAt[v] == (size_t)-1)
+			used++;
+		else if(stats.transforms - loadedAt[v] < (size_t)cacheSize)
+			continue;
+		loadedAt[v] = stats.transforms++;
+	}
+	if(indexCount >= 3)
+		stats.acmr = (double)stats.transforms / (indexCount / 3);
+	if(used > 0)
+		stats.atvr = (double)stats.transforms / used;
+	return stats;
+}
@@ -0,0 +1,179 @@
+#include "Scatter.h"
+#include "../Parallel/ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+
+struct RawPoint
+{
+	float x, y;
+	uint64_t priority;
+};
+
+// Small portable generator, the standard distributions differ between libraries.
+struct ScatterRandom
+{
+	uint64_t state;
+
+	ScatterRandom(uint64_t seed) : state(seed) {}
+
+	float next()
+	{
+		state += 0x9e3779b97f4a7c15ull;
+		uint64_t z = state;
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+		z ^= z >> 31;
+		return (float)(z >> 40) * (1.0f / 16777216.0f);
+	}
+};
+
+// Bridson's sampling of one chunk in chunk local coordinates [0, size)^2.
+static void sampleChunk(const ScatterSettings &settings, const ChunkKey &key, std::vector<RawPoint> &points)
+{
+	const float radius = settings.minDistance;
+	const float size = (float)settings.chunkSize;
+	const float cell = radius / std::sqrt(2.0f);
+	// Two cells of padding on every side so the neighbour scan needs no clamping.
+	const int gridSize = (int)std::ceil(size / cell) + 4;
+	uint64_t seed = chunkSeed(settings.worldSeed, key);
+	ScatterRandom random(seed);
+
+	static thread_local std::vector<int> grid;
+	grid.assign((size_t)gridSize * gridSize, -1);
+	static thread_local std::vector<int> active;
+	active.clear();
+	points.clear();
+
+	auto accept = [&](float x, float y) {
+		int gx = (int)(x / cell) + 2, gy = (int)(y / cell) + 2;
+		for(int ny = gy - 2; ny <= gy + 2; ny++)
+		{
+			for(int nx = gx - 2; nx <= gx + 2; nx++)
+			{
+				int other = grid[(size_t)ny * gridSize + nx];
+				if(other < 0)
+					continue;
+				float dx = points[other].x - x, dy = points[other].y - y;
+				if(dx * dx + dy * dy < radius * radius)
+					return false;
+			}
+		}
+		RawPoint point = { x, y, mixBits(seed ^ (uint64_t)points.size()) };
+		grid[(size_t)gy * gridSize + gx] = (int)points.size();
+		active.push_back((int)points.size());
+		points.push_back(point);
+		return true;
+	};
+
+	accept(random.next() * size, random.next() * size);
+	while(!active.empty())
+	{
+		size_t pick = (size_t)(random.next() * active.size());
+		pick = std::min(pick, active.size() - 1);
+		RawPoint origin = points[active[pick]];
+		bool placed = false;
+		for(int attempt = 0; attempt < settings.attempts && !placed; attempt++)
+		{
+			// Candidate in the annulus [r, 2r), by rejection instead of sin/cos.
+			float dx = (random.next() * 4.0f - 2.0f) * radius;
+			float dy = (random.next() * 4.0f - 2.0f) * radius;
+			float distance = dx * dx + dy * dy;
+			if(distance < radius * radius || distance >= 4.0f * radius * radius)
+				continue;
+			float x = origin.x + dx;
+			float y = origin.y + dy;
+			if(x >= 0.0f && y >= 0.0f && x < size && y < size)
+				placed = accept(x, y);
+		}
+		if(!placed)
+		{
+			active[pick] = active.back();
+			active.pop_back();
+		}
+	}
+}
+
+void scatterObjects(const HeightMap &map, const NormalMap *normals, const MaterialMap *materials,
+	const ScatterSettings &settings, std::vector<std::vector<ScatterInstance>> &chunks)
+{
+	const int size = settings.chunkSize;
+	const int chunksX = (map.width + size - 1) / size;
+	const int chunksY = (map.height + size - 1) / size;
+	chunks.assign((size_t)chunksX * chunksY, std::vector<ScatterInstance>());
+	if(chunksX == 0 || chunksY == 0 || map.width < 2 || map.height < 2)
+		return;
+
+	// Raw points for the chunks plus a ring of neighbours around them, so seams
+	// at the map border resolve exactly like seams anywhere else.
+	const int rawX = chunksX + 2, rawY = chunksY + 2;
+	const float radius = settings.minDistance;
+	std::vector<std::vector<RawPoint>> raw((size_t)rawX * rawY);
+	// Points within one radius of the chunk edge, the only ones a seam can touch.
+	std::vector<std::vector<RawPoint>> border((size_t)rawX * rawY);
+	ThreadPool::global().parallelFor(rawX * rawY, 1, [&](int first, int last) {
+		for(int i = first; i < last; i++)
+		{
+			ChunkKey key(settings.originChunkX + i % rawX - 1, settings.originChunkY + i / rawX - 1);
+			sampleChunk(settings, key, raw[i]);
+			for(const RawPoint &point : raw[i])
+			{
+				if(point.x < radius || point.y < radius || point.x >= size - radius || point.y >= size - radius)
+					border[i].push_back(point);
+			}
+		}
+	});
+
+	ThreadPool::global().parallelFor(chunksX * chunksY, 1, [&](int first, int last) {
+		for(int c = first; c < last; c++)
+		{
+			int cx = c % chunksX, cy = c / chunksX;
+			const std::vector<RawPoint> &own = raw[(size_t)(cy + 1) * rawX + cx + 1];
+			std::vector<ScatterInstance> &out = chunks[c];
+			for(const RawPoint &point : own)
+			{
+				// Seam: drop the point if a neighbour's point is too close and wins.
+				bool keep = true;
+				bool nearEdge = point.x < radius || point.y < radius || point.x >= size - radius || point.y >= size - radius;
+				for(int ny = -1; ny <= 1 && keep && nearEdge; ny++)
+				{
+					for(int nx = -1; nx <= 1 && keep; nx++)
+					{
+						if(nx == 0 && ny == 0)
+							continue;
+						for(const RawPoint &other : border[(size_t)(cy + 1 + ny) * rawX + cx + 1 + nx])
+						{
+							float dx = other.x + nx * size - point.x, dy = other.y + ny * size - point.y;
+							if(dx * dx + dy * dy < radius * radius && other.priority > point.priority)
+							{
+								keep = false;
+								break;
+							}
+						}
+					}
+				}
+				if(!keep)
+					continue;
+
+				float x = cx * size + point.x, y = cy * size + point.y;
+				if(x > map.width - 1 || y > map.height - 1)
+					continue;
+				int sx = std::min((int)x, map.width - 2), sy = std::min((int)y, map.height - 2);
+				float fx = x - sx, fy = y - sy;
+				float top = map.at(sx, sy) + (map.at(sx + 1, sy) - map.at(sx, sy)) * fx;
+				float bottom = map.at(sx, sy + 1) + (map.at(sx + 1, sy + 1) - map.at(sx, sy + 1)) * fx;
+				float z = top + (bottom - top) * fy;
+				if(z < settings.minHeight || z > settings.maxHeight)
+					continue;
+
+				size_t nearest = (size_t)(int)(y + 0.5f) * map.width + (int)(x + 0.5f);
+				if(normals && normals->slopes[nearest] > settings.maxSlope)
+					continue;
+				if(materials && !(settings.materialMask & (1u << materials->materials[nearest])))
+					continue;
+
+				ScatterInstance instance = { x, y, z, (float)(point.priority >> 40) * (1.0f / 16777216.0f) };
+				out.push_back(instance);
+			}
+		}
+	});
+}
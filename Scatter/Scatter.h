@@ -0,0 +1,47 @@
+#ifndef SCATTER_H
+#define SCATTER_H
+
+#include <cstdint>
+#include <vector>
+#include "../TerrainGenerator/HeightMap.h"
+#include "../TerrainGenerator/NormalMap.h"
+#include "../TerrainGenerator/MaterialClassifier.h"
+#include "../TerrainGenerator/ChunkKey.h"
+
+struct ScatterInstance
+{
+	// Map space position, z is the terrain height under the instance.
+	float x, y, z;
+	// Per instance random value in [0, 1) for picking variants, rotation or scale.
+	float random;
+};
+
+struct ScatterSettings
+{
+	uint64_t worldSeed = 0;
+	// Samples per chunk side and the chunk coordinate of map sample (0, 0).
+	int chunkSize = 64;
+	int originChunkX = 0, originChunkY = 0;
+	// Minimum distance between instances, in samples.
+	float minDistance = 4.0f;
+	// Bridson candidates tried around each active point.
+	int attempts = 30;
+
+	float minHeight = -1e30f, maxHeight = 1e30f;
+	float maxSlope = 1e30f;
+	// Bit per TerrainMaterial that instances may stand on.
+	uint32_t materialMask = 0xffffffffu;
+};
+
+// Poisson-disk scatter over a map, one chunk per task.
+// Every chunk runs Bridson's algorithm with a background grid, seeded by
+// chunkSeed(), so its raw points depend on nothing but the seed and chunk
+// address. Points closer than minDistance across a chunk seam are resolved
+// by a per point priority that both chunks agree on, then the survivors are
+// filtered by height, slope and material. `normals` and `materials` may be
+// null to skip those filters. `chunks` receives one list per chunk, row by
+// row over the chunks covering the map.
+void scatterObjects(const HeightMap &map, const NormalMap *normals, const MaterialMap *materials,
+	const ScatterSettings &settings, std::vector<std::vector<ScatterInstance>> &chunks);
+
+#endif
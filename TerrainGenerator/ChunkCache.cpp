@@ -0,0 +1,290 @@
+#include "ChunkCache.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const char CHUNK_CACHE_MAGIC[8] = { 'E', 'X', 'P', 'C', 'H', 'U', 'N', 'K' };
+const uint32_t CHUNK_CACHE_VERSION = 1;
+const uint32_t MAX_SECTIONS = 8;
+// Section payloads start on this boundary so they can be used in place.
+const size_t SECTION_ALIGN = 16;
+
+enum ChunkSection
+{
+	SECTION_HEIGHTS = 1,
+	SECTION_NORMALS = 2,
+	SECTION_SLOPES = 3,
+	SECTION_MATERIALS = 4,
+	SECTION_MESH = 5
+};
+
+struct FileHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t sectionCount;
+	uint64_t parameterHash;
+	uint64_t chunkHash;
+	int32_t width, height;
+};
+
+struct SectionEntry
+{
+	uint32_t type;
+	uint32_t reserved;
+	uint64_t offset;
+	uint64_t size;
+};
+
+static std::string toHex(uint64_t value)
+{
+	char text[17];
+	snprintf(text, sizeof(text), "%016llx", (unsigned long long)value);
+	return text;
+}
+
+ChunkCache::ChunkCache(const std::string &directory) : directory(directory), hits(0), misses(0), writes(0)
+{
+	if(mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST)
+		std::cout << "ERROR::CHUNKCACHE::COULD_NOT_CREATE " << directory << std::endl;
+}
+
+uint64_t ChunkCache::chunkHash(const TerrainGenerator &generator, const ChunkKey &key, int chunkSize, uint64_t salt) const
+{
+	uint64_t h = chunkSeed(generator.getParameterHash(), key);
+	h = mixBits(h ^ (uint64_t)(uint32_t)chunkSize);
+	return mixBits(h ^ salt);
+}
+
+std::string ChunkCache::parameterDirectory(const TerrainGenerator &generator) const
+{
+	return directory + "/" + toHex(generator.getParameterHash());
+}
+
+std::string ChunkCache::chunkPath(const TerrainGenerator &generator, const ChunkKey &key, int chunkSize, uint64_t salt) const
+{
+	return parameterDirectory(generator) + "/" + toHex(chunkHash(generator, key, chunkSize, salt)) + ".chunk";
+}
+
+bool ChunkCache::load(const TerrainGenerator &generator, const ChunkKey &key, int chunkSize, HeightMap &map,
+	NormalMap *normals, MaterialMap *materials, std::vector<uint8_t> *mesh, uint64_t salt)
+{
+	int fd = open(chunkPath(generator, key, chunkSize, salt).c_str(), O_RDONLY);
+	if(fd < 0)
+	{
+		misses++;
+		return false;
+	}
+	struct stat info;
+	size_t fileSize = fstat(fd, &info) == 0 ? (size_t)info.st_size : 0;
+	void *mapping = MAP_FAILED;
+	if(fileSize >= sizeof(FileHeader))
+		mapping = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+	::close(fd);
+	if(mapping == MAP_FAILED)
+	{
+		misses++;
+		return false;
+	}
+
+	const unsigned char *data = (const unsigned char*)mapping;
+	const FileHeader *header = (const FileHeader*)data;
+	const int size = chunkSize + 1;
+	const size_t samples = (size_t)size * size;
+	bool valid = memcmp(header->magic, CHUNK_CACHE_MAGIC, sizeof(CHUNK_CACHE_MAGIC)) == 0
+		&& header->version == CHUNK_CACHE_VERSION
+		&& header->parameterHash == generator.getParameterHash()
+		&& header->chunkHash == chunkHash(generator, key, chunkSize, salt)
+		&& header->width == size && header->height == size
+		&& header->sectionCount <= MAX_SECTIONS
+		&& sizeof(FileHeader) + header->sectionCount * sizeof(SectionEntry) <= fileSize;
+
+	// Locate the sections, rejecting any that would read past the file.
+	const SectionEntry *found[SECTION_MESH + 1] = {};
+	const SectionEntry *table = (const SectionEntry*)(data + sizeof(FileHeader));
+	for(uint32_t i = 0; valid && i < header->sectionCount; i++)
+	{
+		const SectionEntry &entry = table[i];
+		if(entry.offset > fileSize || entry.size > fileSize - entry.offset)
+			valid = false;
+		else if(entry.type >= SECTION_HEIGHTS && entry.type <= SECTION_MESH)
+			found[entry.type] = &entry;
+	}
+	auto sectionFits = [&](int type, size_t bytes) {
+		return found[type] && found[type]->size == bytes;
+	};
+	valid = valid && sectionFits(SECTION_HEIGHTS, samples * sizeof(float))
+		&& (!normals || (sectionFits(SECTION_NORMALS, samples * sizeof(uint32_t)) && sectionFits(SECTION_SLOPES, samples * sizeof(float))))
+		&& (!materials || sectionFits(SECTION_MATERIALS, samples))
+		&& (!mesh || found[SECTION_MESH]);
+
+	if(valid)
+	{
+		map.resize(size, size);
+		memcpy(map.heights.data(), data + found[SECTION_HEIGHTS]->offset, samples * sizeof(float));
+		if(normals)
+		{
+			normals->resize(size, size);
+			memcpy(normals->normals.data(), data + found[SECTION_NORMALS]->offset, samples * sizeof(uint32_t));
+			memcpy(normals->slopes.data(), data + found[SECTION_SLOPES]->offset, samples * sizeof(float));
+		}
+		if(materials)
+		{
+			materials->resize(size, size);
+			memcpy(materials->materials.data(), data + found[SECTION_MATERIALS]->offset, samples);
+		}
+		if(mesh)
+		{
+			const unsigned char *bytes = data + found[SECTION_MESH]->offset;
+			mesh->assign(bytes, bytes + found[SECTION_MESH]->size);
+		}
+	}
+	munmap(mapping, fileSize);
+	if(valid)
+		hits++;
+	else
+		misses++;
+	return valid;
+}
+
+bool ChunkCache::store(const TerrainGenerator &generator, const ChunkKey &key, int chunkSize, const HeightMap &map,
+	const NormalMap *normals, const MaterialMap *materials, const std::vector<uint8_t> *mesh, uint64_t salt)
+{
+	const int size = chunkSize + 1;
+	const size_t samples = (size_t)size * size;
+	if(map.width != size || map.height != size
+		|| (normals && (normals->width != size || normals->height != size))
+		|| (materials && (materials->width != size || materials->height != size)))
+	{
+		return false;
+	}
+
+	struct Payload
+	{
+		uint32_t type;
+		const void *bytes;
+		size_t size;
+	};
+	std::vector<Payload> payloads;
+	payloads.push_back({ SECTION_HEIGHTS, map.heights.data(), samples * sizeof(float) });
+	if(normals)
+	{
+		payloads.push_back({ SECTION_NORMALS, normals->normals.data(), samples * sizeof(uint32_t) });
+		payloads.push_back({ SECTION_SLOPES, normals->slopes.data(), samples * sizeof(float) });
+	}
+	if(materials)
+		payloads.push_back({ SECTION_MATERIALS, materials->materials.data(), samples });
+	if(mesh)
+		payloads.push_back({ SECTION_MESH, mesh->data(), mesh->size() });
+
+	// Lay the whole file out in memory so it goes to disk in one write.
+	auto align = [](size_t offset) { return (offset + SECTION_ALIGN - 1) / SECTION_ALIGN * SECTION_ALIGN; };
+	size_t offset = align(sizeof(FileHeader) + payloads.size() * sizeof(SectionEntry));
+	std::vector<SectionEntry> table;
+	for(const Payload &payload : payloads)
+	{
+		table.push_back({ payload.type, 0, offset, payload.size });
+		offset = align(offset + payload.size);
+	}
+	std::vector<unsigned char> file(offset, 0);
+	FileHeader header;
+	memcpy(header.magic, CHUNK_CACHE_MAGIC, sizeof(CHUNK_CACHE_MAGIC));
+	header.version = CHUNK_CACHE_VERSION;
+	header.sectionCount = payloads.size();
+	header.parameterHash = generator.getParameterHash();
+	header.chunkHash = chunkHash(generator, key, chunkSize, salt);
+	header.width = size;
+	header.height = size;
+	memcpy(file.data(), &header, sizeof(header));
+	memcpy(file.data() + sizeof(header), table.data(), table.size() * sizeof(SectionEntry));
+	for(size_t i = 0; i < payloads.size(); i++)
+	{
+		if(payloads[i].size)
+			memcpy(file.data() + table[i].offset, payloads[i].bytes, payloads[i].size);
+	}
+
+	std::string folder = parameterDirectory(generator);
+	if(mkdir(folder.c_str(), 0755) != 0 && errno != EEXIST)
+	{
+		std::cout << "ERROR::CHUNKCACHE::COULD_NOT_CREATE " << folder << std::endl;
+		return false;
+	}
+	static std::atomic<unsigned int> temporaryCounter(0);
+	std::string path = chunkPath(generator, key, chunkSize, salt);
+	std::string temporary = path + "." + std::to_string(getpid()) + "." + std::to_string(temporaryCounter++) + ".tmp";
+	int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	bool written = fd >= 0;
+	for(size_t done = 0; written && done < file.size();)
+	{
+		ssize_t count = write(fd, file.data() + done, file.size() - done);
+		if(count < 0 && errno == EINTR)
+			continue;
+		written = count > 0;
+		done += written ? (size_t)count : 0;
+	}
+	if(fd >= 0)
+		::close(fd);
+	if(!written || rename(temporary.c_str(), path.c_str()) != 0)
+	{
+		unlink(temporary.c_str());
+		std::cout << "ERROR::CHUNKCACHE::COULD_NOT_WRITE " << path << std::endl;
+		return false;
+	}
+	writes++;
+	return true;
+}
+
+void ChunkCache::generateChunk(TerrainGenerator &generator, const ChunkKey &key, int chunkSize, HeightMap &map,
+	NormalMap *normals, MaterialMap *materials, const MaterialClassifier *classifier)
+{
+	// Materials depend on the rules as well as the generator.
+	uint64_t salt = 0;
+	if(materials)
+		salt = (classifier ? classifier : &MaterialClassifier::defaults())->hash();
+	if(load(generator, key, chunkSize, map, normals, materials, nullptr, salt))
+		return;
+	generator.GenerateChunk(key, chunkSize, map, normals, materials, classifier);
+	store(generator, key, chunkSize, map, normals, materials, nullptr, salt);
+}
+
+void ChunkCache::removeStale(const TerrainGenerator &generator)
+{
+	std::string current = toHex(generator.getParameterHash());
+	DIR *root = opendir(directory.c_str());
+	if(!root)
+		return;
+	std::vector<std::string> stale;
+	while(dirent *entry = readdir(root))
+	{
+		std::string name = entry->d_name;
+		// Only touch folders this cache could have created.
+		if(name.size() == 16 && name != current && name.find_first_not_of("0123456789abcdef") == std::string::npos)
+			stale.push_back(directory + "/" + name);
+	}
+	closedir(root);
+
+	for(const std::string &folder : stale)
+	{
+		DIR *files = opendir(folder.c_str());
+		if(!files)
+			continue;
+		while(dirent *entry = readdir(files))
+		{
+			std::string name = entry->d_name;
+			if(name != "." && name != "..")
+				unlink((folder + "/" + name).c_str());
+		}
+		closedir(files);
+		rmdir(folder.c_str());
+	}
+}
+
+ChunkCacheStats ChunkCache::stats() const
+{
+	return { hits.load(), misses.load(), writes.load() };
+}
@@ -0,0 +1,54 @@
+#ifndef CHUNKCACHE_H
+#define CHUNKCACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "TerrainGenerator.h"
+
+struct ChunkCacheStats
+{
+	uint64_t hits, misses, writes;
+};
+
+// Content addressed disk cache of finished chunks.
+// A chunk is filed under the generator's parameter hash and a hash of that,
+// the chunk key, the chunk size and an optional salt (e.g. the material
+// classifier's hash), so changing any parameter simply misses and leaves the
+// old files behind for removeStale(). Each file holds a header, a section
+// table and the sections (heights, normals, slopes, materials, mesh) and is
+// read back with one mmap. Files are written to a temporary name and renamed,
+// so concurrent writers and crashes never leave a half written chunk behind.
+class ChunkCache
+{
+public:
+	ChunkCache(const std::string &directory);
+
+	uint64_t chunkHash(const TerrainGenerator &generator, const ChunkKey &key, int chunkSize, uint64_t salt = 0) const;
+
+	// Fills every non-null output from the cache. Returns false, leaving the
+	// outputs unspecified, when the chunk or any requested section is missing.
+	bool load(const TerrainGenerator &generator, const ChunkKey &key, int chunkSize, HeightMap &map,
+		NormalMap *normals = nullptr, MaterialMap *materials = nullptr, std::vector<uint8_t> *mesh = nullptr, uint64_t salt = 0);
+	bool store(const TerrainGenerator &generator, const ChunkKey &key, int chunkSize, const HeightMap &map,
+		const NormalMap *normals = nullptr, const MaterialMap *materials = nullptr, const std::vector<uint8_t> *mesh = nullptr,
+		uint64_t salt = 0);
+
+	// GenerateChunk through the cache: loads the chunk, or generates and stores it.
+	void generateChunk(TerrainGenerator &generator, const ChunkKey &key, int chunkSize, HeightMap &map,
+		NormalMap *normals = nullptr, MaterialMap *materials = nullptr, const MaterialClassifier *classifier = nullptr);
+
+	// Deletes the chunks of every parameter set other than the generator's.
+	void removeStale(const TerrainGenerator &generator);
+	ChunkCacheStats stats() const;
+
+private:
+	std::string directory;
+	std::atomic<uint64_t> hits, misses, writes;
+
+	std::string parameterDirectory(const TerrainGenerator &generator) const;
+	std::string chunkPath(const TerrainGenerator &generator, const ChunkKey &key, int chunkSize, uint64_t salt) const;
+};
+
+#endif
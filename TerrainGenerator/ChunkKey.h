@@ -0,0 +1,47 @@
+#ifndef CHUNKKEY_H
+#define CHUNKKEY_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Address of a chunk. At LOD l a chunk covers chunkSize << l world samples
+// per side and keeps chunkSize + 1 samples, so (x, y) count chunks of that
+// LOD's size.
+struct ChunkKey
+{
+	int32_t x = 0, y = 0;
+	int32_t lod = 0;
+
+	ChunkKey() {}
+	ChunkKey(int32_t x, int32_t y, int32_t lod = 0) : x(x), y(y), lod(lod) {}
+
+	bool operator==(const ChunkKey &other) const { return x == other.x && y == other.y && lod == other.lod; }
+	bool operator!=(const ChunkKey &other) const { return !(*this == other); }
+};
+
+// SplitMix64 finalizer, the same on every platform and standard library.
+inline uint64_t mixBits(uint64_t value)
+{
+	value += 0x9e3779b97f4a7c15ull;
+	value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+	value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+	return value ^ (value >> 31);
+}
+
+// Seed for anything random inside a chunk (scatter, detail noise), derived
+// only from the world seed and the chunk address so chunks can be produced
+// in any order, on any thread or machine.
+inline uint64_t chunkSeed(uint64_t worldSeed, const ChunkKey &key)
+{
+	uint64_t h = mixBits(worldSeed);
+	h = mixBits(h ^ (uint32_t)key.x);
+	h = mixBits(h ^ ((uint64_t)(uint32_t)key.y << 1));
+	return mixBits(h ^ ((uint64_t)(uint32_t)key.lod << 2));
+}
+
+struct ChunkKeyHash
+{
+	size_t operator()(const ChunkKey &key) const { return (size_t)chunkSeed(0, key); }
+};
+
+#endif
@@ -0,0 +1,296 @@
+#include "HeightCodec.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+
+const uint32_t HEIGHT_CODEC_MAGIC = 0x43484558; // "EXHC"
+const uint8_t MODE_QUANTIZED = 0;
+const uint8_t MODE_FLOAT_BITS = 1;
+const int BLOCK_SIZE = 32;
+// The decoder reads residuals through 8 byte windows.
+const size_t TAIL_PADDING = 8;
+
+struct ChunkHeader
+{
+	uint32_t magic;
+	uint32_t width, height;
+	uint8_t mode;
+	uint8_t reserved[3];
+	float offset;
+	float step;
+};
+
+// Maps float bits to integers that sort in the same order as the floats.
+static uint32_t orderedBits(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+}
+
+static float fromOrderedBits(uint32_t bits)
+{
+	bits = (bits & 0x80000000u) ? (bits & 0x7fffffffu) : ~bits;
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+// Shared by the encoder's bound check and the decoder so both round alike.
+static inline float dequantize(const ChunkHeader &header, uint32_t value)
+{
+	return header.offset + (float)value * header.step;
+}
+
+static uint32_t zigzag(uint32_t residual)
+{
+	return (residual << 1) ^ (uint32_t)((int32_t)residual >> 31);
+}
+
+static uint32_t unzigzag(uint32_t value)
+{
+	return (value >> 1) ^ (0u - (value & 1));
+}
+
+template<int BITS>
+static void unpackBlock(const uint8_t *src, uint32_t *dst)
+{
+	const uint64_t mask = BITS == 32 ? 0xffffffffull : ((1ull << BITS) - 1);
+	for(int i = 0; i < BLOCK_SIZE; i++)
+	{
+		uint64_t window;
+		memcpy(&window, src + (i * BITS >> 3), sizeof(window));
+		dst[i] = unzigzag((uint32_t)((window >> (i * BITS & 7)) & mask));
+	}
+}
+
+typedef void (*UnpackFunction)(const uint8_t*, uint32_t*);
+
+// One unpacker per bit width so shifts and masks are compile time constants.
+static const UnpackFunction UNPACKERS[33] = {
+	unpackBlock<0>, unpackBlock<1>, unpackBlock<2>, unpackBlock<3>, unpackBlock<4>, unpackBlock<5>,
+	unpackBlock<6>, unpackBlock<7>, unpackBlock<8>, unpackBlock<9>, unpackBlock<10>, unpackBlock<11>,
+	unpackBlock<12>, unpackBlock<13>, unpackBlock<14>, unpackBlock<15>, unpackBlock<16>, unpackBlock<17>,
+	unpackBlock<18>, unpackBlock<19>, unpackBlock<20>, unpackBlock<21>, unpackBlock<22>, unpackBlock<23>,
+	unpackBlock<24>, unpackBlock<25>, unpackBlock<26>, unpackBlock<27>, unpackBlock<28>, unpackBlock<29>,
+	unpackBlock<30>, unpackBlock<31>, unpackBlock<32>
+};
+
+static void packBlock(const uint32_t *values, std::vector<uint8_t> &out)
+{
+	uint32_t all = 0;
+	for(int i = 0; i < BLOCK_SIZE; i++)
+		all |= values[i];
+	int bits = 0;
+	while(bits < 32 && (all >> bits) != 0)
+		bits++;
+
+	out.push_back((uint8_t)bits);
+	size_t start = out.size();
+	out.resize(start + BLOCK_SIZE / 8 * bits, 0);
+	uint8_t *dst = out.data() + start;
+	for(int i = 0; i < BLOCK_SIZE && bits > 0; i++)
+	{
+		size_t bit = (size_t)i * bits;
+		uint64_t shifted = (uint64_t)values[i] << (bit & 7);
+		for(size_t b = bit >> 3; shifted != 0; b++, shifted >>= 8)
+			dst[b] |= (uint8_t)shifted;
+	}
+}
+
+std::vector<uint8_t> encodeHeights(const float *heights, int width, int height, int stride, float maxError)
+{
+	size_t count = (size_t)width * height;
+	float low = 0.0f, high = 0.0f;
+	if(count > 0)
+	{
+		low = high = heights[0];
+		for(int y = 0; y < height; y++)
+		{
+			const float *row = heights + (size_t)y * stride;
+			for(int x = 0; x < width; x++)
+			{
+				low = std::min(low, row[x]);
+				high = std::max(high, row[x]);
+			}
+		}
+	}
+
+	ChunkHeader header = {};
+	header.magic = HEIGHT_CODEC_MAGIC;
+	header.width = width;
+	header.height = height;
+	header.mode = MODE_FLOAT_BITS;
+	header.offset = low;
+	// Half a step of quantization error plus the rounding of offset + q * step,
+	// which is up to one float spacing at the chunk's largest magnitude, with a
+	// little slack for the encoder's own rounding.
+	float magnitude = std::max(std::fabs(low), std::fabs(high));
+	float spacing = std::nextafter(magnitude, INFINITY) - magnitude;
+	header.step = (maxError - spacing) * 1.98f;
+	if(header.step > 0.0f && (high - low) / header.step <= 65535.0f)
+		header.mode = MODE_QUANTIZED;
+
+	std::vector<uint32_t> quantized(count);
+	if(header.mode == MODE_QUANTIZED)
+	{
+		float invStep = 1.0f / header.step;
+		for(int y = 0; y < height && header.mode == MODE_QUANTIZED; y++)
+		{
+			const float *row = heights + (size_t)y * stride;
+			uint32_t *dst = quantized.data() + (size_t)y * width;
+			for(int x = 0; x < width; x++)
+			{
+				dst[x] = (uint32_t)std::lrint((row[x] - low) * invStep);
+				// The bound is a promise, anything the estimate above missed is coded losslessly.
+				if(!(std::fabs(dequantize(header, dst[x]) - row[x]) <= maxError))
+				{
+					header.mode = MODE_FLOAT_BITS;
+					break;
+				}
+			}
+		}
+	}
+	if(header.mode == MODE_FLOAT_BITS)
+	{
+		for(int y = 0; y < height; y++)
+		{
+			const float *row = heights + (size_t)y * stride;
+			uint32_t *dst = quantized.data() + (size_t)y * width;
+			for(int x = 0; x < width; x++)
+				dst[x] = orderedBits(row[x]);
+		}
+	}
+
+	std::vector<uint8_t> out(sizeof(header));
+	memcpy(out.data(), &header, sizeof(header));
+	out.reserve(sizeof(header) + count + TAIL_PADDING);
+
+	// Residuals of the planar predictor left + up - upLeft, wrapping in 32 bits.
+	uint32_t block[BLOCK_SIZE];
+	int filled = 0;
+	for(int y = 0; y < height; y++)
+	{
+		const uint32_t *row = quantized.data() + (size_t)y * width;
+		const uint32_t *up = y > 0 ? row - width : nullptr;
+		for(int x = 0; x < width; x++)
+		{
+			uint32_t predicted;
+			if(y == 0)
+				predicted = x > 0 ? row[x - 1] : 0;
+			else if(x == 0)
+				predicted = up[0];
+			else
+				predicted = row[x - 1] + up[x] - up[x - 1];
+			block[filled++] = zigzag(row[x] - predicted);
+			if(filled == BLOCK_SIZE)
+			{
+				packBlock(block, out);
+				filled = 0;
+			}
+		}
+	}
+	if(filled > 0)
+	{
+		std::fill(block + filled, block + BLOCK_SIZE, 0);
+		packBlock(block, out);
+	}
+	out.insert(out.end(), TAIL_PADDING, 0);
+	return out;
+}
+
+std::vector<uint8_t> encodeHeights(const HeightMap &map, float maxError)
+{
+	return encodeHeights(map.heights.data(), map.width, map.height, map.width, maxError);
+}
+
+bool readHeightsHeader(const uint8_t *data, size_t size, int &width, int &height)
+{
+	ChunkHeader header;
+	if(size < sizeof(header) + TAIL_PADDING)
+		return false;
+	memcpy(&header, data, sizeof(header));
+	if(header.magic != HEIGHT_CODEC_MAGIC || header.mode > MODE_FLOAT_BITS)
+		return false;
+	if(header.width == 0 || header.height == 0 || header.width > INT_MAX || header.height > INT_MAX)
+		return false;
+	// Every block costs at least its width byte, so the payload bounds the sample count
+	// before anything is allocated from the untrusted dimensions.
+	uint64_t blocks = ((uint64_t)header.width * header.height + BLOCK_SIZE - 1) / BLOCK_SIZE;
+	if(blocks > size - sizeof(header) - TAIL_PADDING)
+		return false;
+	width = header.width;
+	height = header.height;
+	return true;
+}
+
+bool decodeHeights(const uint8_t *data, size_t size, float *out, int stride)
+{
+	int width, height;
+	if(!readHeightsHeader(data, size, width, height))
+		return false;
+	ChunkHeader header;
+	memcpy(&header, data, sizeof(header));
+
+	// Unpack every residual first so the reconstruction below is branch free.
+	size_t count = (size_t)width * height;
+	size_t blocks = (count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+	static thread_local std::vector<uint32_t> residuals;
+	residuals.resize(blocks * BLOCK_SIZE);
+	const uint8_t *src = data + sizeof(header);
+	const uint8_t *end = data + size - TAIL_PADDING;
+	for(size_t block = 0; block < blocks; block++)
+	{
+		if(src >= end)
+			return false;
+		int bits = *src++;
+		if(bits > 32 || src + BLOCK_SIZE / 8 * bits > end)
+			return false;
+		UNPACKERS[bits](src, residuals.data() + block * BLOCK_SIZE);
+		src += BLOCK_SIZE / 8 * bits;
+	}
+
+	static thread_local std::vector<uint32_t> rows;
+	rows.resize(2 * (size_t)width);
+	for(int y = 0; y < height; y++)
+	{
+		const uint32_t *r = residuals.data() + (size_t)y * width;
+		uint32_t *row = rows.data() + (size_t)(y & 1) * width;
+		const uint32_t *up = rows.data() + (size_t)((y + 1) & 1) * width;
+		if(y == 0)
+		{
+			uint32_t left = 0;
+			for(int x = 0; x < width; x++)
+				row[x] = left = left + r[x];
+		}
+		else if(width > 0)
+		{
+			uint32_t left = row[0] = up[0] + r[0];
+			for(int x = 1; x < width; x++)
+				row[x] = left = left + r[x] + (up[x] - up[x - 1]);
+		}
+
+		float *dst = out + (size_t)y * stride;
+		if(header.mode == MODE_QUANTIZED)
+		{
+			for(int x = 0; x < width; x++)
+				dst[x] = dequantize(header, row[x]);
+		}
+		else
+		{
+			for(int x = 0; x < width; x++)
+				dst[x] = fromOrderedBits(row[x]);
+		}
+	}
+	return true;
+}
+
+bool decodeHeights(const uint8_t *data, size_t size, HeightMap &out)
+{
+	int width, height;
+	if(!readHeightsHeader(data, size, width, height))
+		return false;
+	out.resize(width, height);
+	return decodeHeights(data, size, out.heights.data(), width);
+}
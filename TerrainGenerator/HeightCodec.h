@@ -0,0 +1,27 @@
+#ifndef HEIGHTCODEC_H
+#define HEIGHTCODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "HeightMap.h"
+
+// Compact encoding for smooth height chunks.
+// Heights are quantized to 16 bits with a per-chunk offset and step chosen
+// from the error bound, predicted from their left, upper and upper-left
+// neighbours, and the zigzagged residuals are bit-packed in blocks of 32
+// with one width byte per block. A zero error bound, or a chunk whose range
+// does not fit 16 bits at the requested bound, is coded losslessly from the
+// float bit patterns through the same predictor.
+
+// Every decoded sample is within `maxError` of the input.
+std::vector<uint8_t> encodeHeights(const float *heights, int width, int height, int stride, float maxError);
+std::vector<uint8_t> encodeHeights(const HeightMap &map, float maxError);
+
+// Reads the chunk dimensions, returns false for data that is not a chunk.
+bool readHeightsHeader(const uint8_t *data, size_t size, int &width, int &height);
+// Decodes into `out`, which must hold height rows of `stride` floats.
+bool decodeHeights(const uint8_t *data, size_t size, float *out, int stride);
+bool decodeHeights(const uint8_t *data, size_t size, HeightMap &out);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef HEIGHTMAP_H
+#define HEIGHTMAP_H
+
+#include <cstddef>
+#include <vector>
+
+// Flat row-major grid of height samples.
+struct HeightMap
+{
+	int width = 0, height = 0;
+	std::vector<float> heights;
+
+	HeightMap() {}
+	HeightMap(int w, int h) : width(w), height(h), heights((size_t)w * h) {}
+
+	void resize(int w, int h)
+	{
+		width = w;
+		height = h;
+		heights.resize((size_t)w * h);
+	}
+
+	float *row(int y) { return heights.data() + (size_t)y * width; }
+	const float *row(int y) const { return heights.data() + (size_t)y * width; }
+	float &at(int x, int y) { return heights[(size_t)y * width + x]; }
+	float at(int x, int y) const { return heights[(size_t)y * width + x]; }
+};
+
+#endif
@@ -0,0 +1,253 @@
+#include "HeightPyramid.h"
+#include "../Parallel/ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+HeightPyramid::HeightPyramid(const HeightMap &map) : map(map)
+{
+	int width = std::max(map.width - 1, 1);
+	int height = std::max(map.height - 1, 1);
+	while(true)
+	{
+		Level level;
+		level.width = width;
+		level.height = height;
+		level.minimum.resize((size_t)width * height);
+		level.maximum.resize((size_t)width * height);
+		levels.push_back(level);
+		if(width == 1 && height == 1)
+			break;
+		width = (width + 1) / 2;
+		height = (height + 1) / 2;
+	}
+	update(0, 0, map.width - 1, map.height - 1);
+}
+
+void HeightPyramid::update(int x0, int y0, int x1, int y1)
+{
+	if(map.width < 2 || map.height < 2)
+	{
+		float h = map.heights.empty() ? 0.0f : map.heights[0];
+		for(Level &level : levels)
+		{
+			std::fill(level.minimum.begin(), level.minimum.end(), h);
+			std::fill(level.maximum.begin(), level.maximum.end(), h);
+		}
+		return;
+	}
+	// Cells touching a changed sample, then their ancestors.
+	x0 = std::max(x0 - 1, 0);
+	y0 = std::max(y0 - 1, 0);
+	x1 = std::min(x1, levels[0].width - 1);
+	y1 = std::min(y1, levels[0].height - 1);
+	for(int level = 0; level < (int)levels.size(); level++)
+	{
+		buildLevel(level, x0, y0, x1, y1);
+		x0 >>= 1;
+		y0 >>= 1;
+		x1 >>= 1;
+		y1 >>= 1;
+	}
+}
+
+void HeightPyramid::buildLevel(int index, int x0, int y0, int x1, int y1)
+{
+	Level &level = levels[index];
+	x1 = std::min(x1, level.width - 1);
+	y1 = std::min(y1, level.height - 1);
+	if(x1 < x0 || y1 < y0)
+		return;
+
+	ThreadPool::global().parallelFor(y1 - y0 + 1, 64, [&](int first, int last) {
+		for(int y = y0 + first; y < y0 + last; y++)
+		{
+			for(int x = x0; x <= x1; x++)
+			{
+				float low, high;
+				if(index == 0)
+				{
+					float a = map.at(x, y), b = map.at(x + 1, y);
+					float c = map.at(x, y + 1), d = map.at(x + 1, y + 1);
+					low = std::min(std::min(a, b), std::min(c, d));
+					high = std::max(std::max(a, b), std::max(c, d));
+				}
+				else
+				{
+					const Level &child = levels[index - 1];
+					low = std::numeric_limits<float>::max();
+					high = -low;
+					for(int cy = 2 * y; cy <= std::min(2 * y + 1, child.height - 1); cy++)
+					{
+						for(int cx = 2 * x; cx <= std::min(2 * x + 1, child.width - 1); cx++)
+						{
+							size_t c = (size_t)cy * child.width + cx;
+							low = std::min(low, child.minimum[c]);
+							high = std::max(high, child.maximum[c]);
+						}
+					}
+				}
+				size_t i = (size_t)y * level.width + x;
+				level.minimum[i] = low;
+				level.maximum[i] = high;
+			}
+		}
+	});
+}
+
+// Ray against the two triangles of a cell, split along its (0,0)-(1,1) diagonal.
+bool HeightPyramid::intersectCell(int cx, int cy, const TerrainRay &ray, float tMin, float tMax, float &t) const
+{
+	float p[4][3] = {
+		{ (float)cx, (float)cy, map.at(cx, cy) },
+		{ (float)cx + 1, (float)cy, map.at(cx + 1, cy) },
+		{ (float)cx + 1, (float)cy + 1, map.at(cx + 1, cy + 1) },
+		{ (float)cx, (float)cy + 1, map.at(cx, cy + 1) }
+	};
+	const int triangles[2][3] = { { 0, 1, 2 }, { 0, 2, 3 } };
+	const float *o = ray.origin, *d = ray.direction;
+	bool found = false;
+	const float epsilon = 1e-5f;
+	for(const auto &tri : triangles)
+	{
+		const float *a = p[tri[0]], *b = p[tri[1]], *c = p[tri[2]];
+		float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+		float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+		float q[3] = { d[1] * e2[2] - d[2] * e2[1], d[2] * e2[0] - d[0] * e2[2], d[0] * e2[1] - d[1] * e2[0] };
+		float det = e1[0] * q[0] + e1[1] * q[1] + e1[2] * q[2];
+		if(std::fabs(det) < 1e-12f)
+			continue;
+		float inv = 1.0f / det;
+		float s[3] = { o[0] - a[0], o[1] - a[1], o[2] - a[2] };
+		float u = (s[0] * q[0] + s[1] * q[1] + s[2] * q[2]) * inv;
+		if(u < -epsilon || u > 1.0f + epsilon)
+			continue;
+		float r[3] = { s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0] };
+		float v = (d[0] * r[0] + d[1] * r[1] + d[2] * r[2]) * inv;
+		if(v < -epsilon || u + v > 1.0f + epsilon)
+			continue;
+		float hitT = (e2[0] * r[0] + e2[1] * r[1] + e2[2] * r[2]) * inv;
+		if(hitT >= tMin - epsilon && hitT <= tMax + epsilon && (!found || hitT < t))
+		{
+			t = std::max(hitT, tMin);
+			found = true;
+		}
+	}
+	return found;
+}
+
+TerrainHit HeightPyramid::raycast(const TerrainRay &ray) const
+{
+	TerrainHit result;
+	if(map.width < 2 || map.height < 2)
+		return result;
+
+	const float *o = ray.origin, *d = ray.direction;
+	float bounds[3][2] = {
+		{ 0.0f, (float)(map.width - 1) },
+		{ 0.0f, (float)(map.height - 1) },
+		{ minHeight(), maxHeight() }
+	};
+
+	// Clip the ray against the bounding box of the terrain.
+	float tEnter = 0.0f, tLeave = ray.maxT;
+	for(int axis = 0; axis < 3; axis++)
+	{
+		if(d[axis] == 0.0f)
+		{
+			if(o[axis] < bounds[axis][0] || o[axis] > bounds[axis][1])
+				return result;
+			continue;
+		}
+		float inv = 1.0f / d[axis];
+		float ta = (bounds[axis][0] - o[axis]) * inv;
+		float tb = (bounds[axis][1] - o[axis]) * inv;
+		tEnter = std::max(tEnter, std::min(ta, tb));
+		tLeave = std::min(tLeave, std::max(ta, tb));
+	}
+	if(tEnter > tLeave)
+		return result;
+
+	// Walk the pyramid with the current base cell kept as integers, so every
+	// exit moves to a new node even when floats land exactly on a boundary.
+	const Level &base = levels[0];
+	int top = levels.size() - 1;
+	int cx = std::min(std::max((int)std::floor(o[0] + d[0] * tEnter), 0), base.width - 1);
+	int cy = std::min(std::max((int)std::floor(o[1] + d[1] * tEnter), 0), base.height - 1);
+	int level = top;
+	float t = tEnter;
+	while(true)
+	{
+		result.visits++;
+		const Level &node = levels[level];
+		int nx = cx >> level, ny = cy >> level;
+		float x0 = (float)(nx << level), x1 = std::min((float)((nx + 1) << level), bounds[0][1]);
+		float y0 = (float)(ny << level), y1 = std::min((float)((ny + 1) << level), bounds[1][1]);
+
+		float tx = d[0] > 0.0f ? (x1 - o[0]) / d[0] : d[0] < 0.0f ? (x0 - o[0]) / d[0] : tLeave;
+		float ty = d[1] > 0.0f ? (y1 - o[1]) / d[1] : d[1] < 0.0f ? (y0 - o[1]) / d[1] : tLeave;
+		float tExit = std::min(std::min(tx, ty), tLeave);
+
+		float zLow = std::min(o[2] + d[2] * t, o[2] + d[2] * tExit);
+		bool above = zLow > node.maximum[(size_t)ny * node.width + nx];
+		if(!above && level > 0)
+		{
+			level--;
+			continue;
+		}
+
+		float hitT;
+		if(!above && intersectCell(cx, cy, ray, t, tExit, hitT))
+		{
+			result.hit = true;
+			result.t = hitT;
+			result.x = o[0] + d[0] * hitT;
+			result.y = o[1] + d[1] * hitT;
+			result.z = o[2] + d[2] * hitT;
+			return result;
+		}
+
+		if(tExit >= tLeave)
+			return result;
+
+		// Step out of the node through the face the ray leaves by.
+		t = tExit;
+		if(tx <= ty)
+		{
+			nx += d[0] > 0.0f ? 1 : -1;
+			if(nx < 0 || nx >= node.width)
+				return result;
+			cx = nx << level;
+			if(d[0] < 0.0f)
+				cx = std::min(((nx + 1) << level) - 1, base.width - 1);
+			int y = (int)std::floor(o[1] + d[1] * t);
+			cy = std::min(std::max(y, ny << level), std::min(((ny + 1) << level) - 1, base.height - 1));
+		}
+		else
+		{
+			ny += d[1] > 0.0f ? 1 : -1;
+			if(ny < 0 || ny >= node.height)
+				return result;
+			cy = ny << level;
+			if(d[1] < 0.0f)
+				cy = std::min(((ny + 1) << level) - 1, base.height - 1);
+			int x = (int)std::floor(o[0] + d[0] * t);
+			cx = std::min(std::max(x, nx << level), std::min(((nx + 1) << level) - 1, base.width - 1));
+		}
+		level = std::min(level + 1, top);
+	}
+}
+
+void HeightPyramid::raycast(const TerrainRay *rays, int count, TerrainHit *hits) const
+{
+	ThreadPool::global().parallelFor(count, 256, [&](int first, int last) {
+		for(int i = first; i < last; i++)
+			hits[i] = raycast(rays[i]);
+	});
+}
+
+bool HeightPyramid::lineOfSight(const float a[3], const float b[3]) const
+{
+	TerrainRay ray = { { a[0], a[1], a[2] }, { b[0] - a[0], b[1] - a[1], b[2] - a[2] }, 1.0f };
+	return !raycast(ray).hit;
+}
@@ -0,0 +1,61 @@
+#ifndef HEIGHTPYRAMID_H
+#define HEIGHTPYRAMID_H
+
+#include <vector>
+#include "HeightMap.h"
+
+struct TerrainRay
+{
+	// Map space: x and y in samples, z in height units.
+	float origin[3];
+	float direction[3];
+	// Hits further than origin + direction * maxT are ignored.
+	float maxT;
+};
+
+struct TerrainHit
+{
+	bool hit = false;
+	float t = 0.0f;
+	float x = 0.0f, y = 0.0f, z = 0.0f;
+	// Pyramid nodes visited by the query.
+	int visits = 0;
+};
+
+// Min/max mip pyramid over the cells of a heightmap. Level 0 holds the
+// bounds of every cell between four samples, each level above halves the
+// resolution until one node covers the whole map. Rays skip any node whose
+// maximum lies below them, so a query visits O(log N) nodes on open terrain
+// instead of stepping through every sample.
+class HeightPyramid
+{
+public:
+	HeightPyramid(const HeightMap &map);
+
+	// Call after the heightmap changed inside the sample rectangle.
+	void update(int x0, int y0, int x1, int y1);
+
+	int levelCount() const { return levels.size(); }
+	float minHeight() const { return levels.back().minimum[0]; }
+	float maxHeight() const { return levels.back().maximum[0]; }
+
+	TerrainHit raycast(const TerrainRay &ray) const;
+	void raycast(const TerrainRay *rays, int count, TerrainHit *hits) const;
+	// True when nothing in the terrain blocks the segment from a to b.
+	bool lineOfSight(const float a[3], const float b[3]) const;
+
+private:
+	struct Level
+	{
+		int width, height;
+		std::vector<float> minimum, maximum;
+	};
+
+	const HeightMap &map;
+	std::vector<Level> levels;
+
+	void buildLevel(int level, int x0, int y0, int x1, int y1);
+	bool intersectCell(int cx, int cy, const TerrainRay &ray, float tMin, float tMax, float &t) const;
+};
+
+#endif
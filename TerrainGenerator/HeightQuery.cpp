@@ -0,0 +1,200 @@
+#include "HeightQuery.h"
+#include "../Parallel/ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define HEIGHT_QUERY_AVX2 1
+#endif
+
+const int TILE_SHIFT = 5;
+// Below this batch size sorting costs more than it saves.
+const int SORT_THRESHOLD = 256;
+const int PARALLEL_GRAIN = 8192;
+
+struct QueryContext
+{
+	const HeightMap *map;
+	const float *xs, *ys;
+	float *heights, *normals;
+	float maxX, maxY;
+	float gradientScale;
+};
+
+// Clamps a query coordinate into the map. Written so that NaN maps to 0 before any float to int conversion.
+static inline float clampCoord(float v, float maxV)
+{
+	return v >= 0.0f ? std::min(v, maxV) : 0.0f;
+}
+
+static void writeNormal(const QueryContext &q, int i, float dx, float dy)
+{
+	dx *= q.gradientScale;
+	dy *= q.gradientScale;
+	float inv = 1.0f / std::sqrt(dx * dx + dy * dy + 1.0f);
+	q.normals[3 * i] = -dx * inv;
+	q.normals[3 * i + 1] = -dy * inv;
+	q.normals[3 * i + 2] = inv;
+}
+
+static void sampleScalar(const QueryContext &q, const int *order, int count)
+{
+	const HeightMap &map = *q.map;
+	for(int k = 0; k < count; k++)
+	{
+		int i = order ? order[k] : k;
+		float x = clampCoord(q.xs[i], q.maxX);
+		float y = clampCoord(q.ys[i], q.maxY);
+		int cx = std::min((int)x, map.width - 2);
+		int cy = std::min((int)y, map.height - 2);
+		float fx = x - cx, fy = y - cy;
+		const float *h = map.row(cy) + cx;
+		float h00 = h[0], h10 = h[1], h01 = h[map.width], h11 = h[map.width + 1];
+		float top = h00 + (h10 - h00) * fx;
+		float bottom = h01 + (h11 - h01) * fx;
+		q.heights[i] = top + (bottom - top) * fy;
+		if(q.normals)
+			writeNormal(q, i, (h10 - h00) + ((h11 - h01) - (h10 - h00)) * fy, bottom - top);
+	}
+}
+
+#ifdef HEIGHT_QUERY_AVX2
+__attribute__((target("avx2")))
+static int sampleAvx2(const QueryContext &q, const int *order, int count)
+{
+	const HeightMap &map = *q.map;
+	const float *base = map.heights.data();
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 maxX = _mm256_set1_ps(q.maxX), maxY = _mm256_set1_ps(q.maxY);
+	const __m256i lastX = _mm256_set1_epi32(map.width - 2), lastY = _mm256_set1_epi32(map.height - 2);
+	const __m256i width = _mm256_set1_epi32(map.width);
+	const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+	int k = 0;
+	for(; k + 8 <= count; k += 8)
+	{
+		__m256i index = order ? _mm256_loadu_si256((const __m256i*)(order + k)) : _mm256_add_epi32(_mm256_set1_epi32(k), lane);
+		// Same as clampCoord: lanes that fail x >= 0 (including NaN) become 0.
+		__m256 x = _mm256_i32gather_ps(q.xs, index, 4);
+		__m256 y = _mm256_i32gather_ps(q.ys, index, 4);
+		x = _mm256_and_ps(_mm256_cmp_ps(x, zero, _CMP_GE_OQ), _mm256_min_ps(x, maxX));
+		y = _mm256_and_ps(_mm256_cmp_ps(y, zero, _CMP_GE_OQ), _mm256_min_ps(y, maxY));
+		__m256i cx = _mm256_min_epi32(_mm256_cvttps_epi32(x), lastX);
+		__m256i cy = _mm256_min_epi32(_mm256_cvttps_epi32(y), lastY);
+		__m256 fx = _mm256_sub_ps(x, _mm256_cvtepi32_ps(cx));
+		__m256 fy = _mm256_sub_ps(y, _mm256_cvtepi32_ps(cy));
+
+		__m256i offset = _mm256_add_epi32(_mm256_mullo_epi32(cy, width), cx);
+		__m256 h00 = _mm256_i32gather_ps(base, offset, 4);
+		__m256 h10 = _mm256_i32gather_ps(base + 1, offset, 4);
+		__m256 h01 = _mm256_i32gather_ps(base + map.width, offset, 4);
+		__m256 h11 = _mm256_i32gather_ps(base + map.width + 1, offset, 4);
+
+		__m256 dTop = _mm256_sub_ps(h10, h00);
+		__m256 dBottom = _mm256_sub_ps(h11, h01);
+		__m256 top = _mm256_add_ps(h00, _mm256_mul_ps(dTop, fx));
+		__m256 bottom = _mm256_add_ps(h01, _mm256_mul_ps(dBottom, fx));
+		__m256 dy = _mm256_sub_ps(bottom, top);
+		__m256 result = _mm256_add_ps(top, _mm256_mul_ps(dy, fy));
+
+		alignas(32) int indices[8];
+		alignas(32) float values[8];
+		_mm256_store_si256((__m256i*)indices, index);
+		_mm256_store_ps(values, result);
+		for(int j = 0; j < 8; j++)
+			q.heights[indices[j]] = values[j];
+
+		if(q.normals)
+		{
+			alignas(32) float gx[8], gy[8];
+			__m256 dx = _mm256_add_ps(dTop, _mm256_mul_ps(_mm256_sub_ps(dBottom, dTop), fy));
+			_mm256_store_ps(gx, dx);
+			_mm256_store_ps(gy, dy);
+			for(int j = 0; j < 8; j++)
+				writeNormal(q, indices[j], gx[j], gy[j]);
+		}
+	}
+	return k;
+}
+
+static bool hasAvx2()
+{
+	static const bool supported = __builtin_cpu_supports("avx2");
+	return supported;
+}
+#endif
+
+static void sampleRange(const QueryContext &q, int first, int last)
+{
+	int count = last - first;
+
+	static thread_local std::vector<int> sorted;
+	static thread_local std::vector<uint32_t> keys;
+	static thread_local std::vector<int> buckets;
+	sorted.resize(count);
+
+	int tilesX = ((q.map->width - 1) >> TILE_SHIFT) + 1;
+	int tilesY = ((q.map->height - 1) >> TILE_SHIFT) + 1;
+	size_t tileCount = (size_t)tilesX * tilesY;
+	// Sorting only pays off once several queries land in the same tile.
+	if(count >= SORT_THRESHOLD && (size_t)count >= tileCount / 4)
+	{
+		// Counting sort of the query indices by tile.
+		keys.resize(count);
+		buckets.assign(tileCount + 1, 0);
+		for(int k = 0; k < count; k++)
+		{
+			int i = first + k;
+			int tx = (int)clampCoord(q.xs[i], q.maxX) >> TILE_SHIFT;
+			int ty = (int)clampCoord(q.ys[i], q.maxY) >> TILE_SHIFT;
+			keys[k] = (uint32_t)(ty * tilesX + tx);
+			buckets[keys[k] + 1]++;
+		}
+		for(size_t b = 1; b < buckets.size(); b++)
+			buckets[b] += buckets[b - 1];
+		for(int k = 0; k < count; k++)
+			sorted[buckets[keys[k]]++] = first + k;
+	}
+	else
+	{
+		for(int k = 0; k < count; k++)
+			sorted[k] = first + k;
+	}
+	const int *order = sorted.data();
+
+	int done = 0;
+#ifdef HEIGHT_QUERY_AVX2
+	if(hasAvx2())
+		done = sampleAvx2(q, order, count);
+#endif
+	sampleScalar(q, order + done, count - done);
+}
+
+void sampleHeights(const HeightMap &map, const float *xs, const float *ys, int count,
+	float *heights, float *normals, float cellSize, float heightScale)
+{
+	if(count <= 0 || map.width < 2 || map.height < 2)
+		return;
+
+	QueryContext q;
+	q.map = &map;
+	q.xs = xs;
+	q.ys = ys;
+	q.heights = heights;
+	q.normals = normals;
+	q.maxX = (float)(map.width - 1);
+	q.maxY = (float)(map.height - 1);
+	q.gradientScale = heightScale / cellSize;
+
+	if(count < 2 * PARALLEL_GRAIN)
+	{
+		sampleRange(q, 0, count);
+		return;
+	}
+	ThreadPool::global().parallelFor(count, PARALLEL_GRAIN, [&q](int first, int last) {
+		sampleRange(q, first, last);
+	});
+}
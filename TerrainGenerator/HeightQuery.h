@@ -0,0 +1,16 @@
+#ifndef HEIGHTQUERY_H
+#define HEIGHTQUERY_H
+
+#include "HeightMap.h"
+
+// Batched ground queries for many positions at once.
+// Positions are in map space (samples) and clamped to the map. Dense batches
+// are sorted by 32 x 32 sample tile before sampling so neighbouring agents
+// share cache lines, and the corners are fetched with AVX2 gathers when the
+// CPU supports them. Results are written in the order the positions were given.
+//
+// `normals` is optional and receives an xyz unit normal per query.
+void sampleHeights(const HeightMap &map, const float *xs, const float *ys, int count,
+	float *heights, float *normals = nullptr, float cellSize = 1.0f, float heightScale = 1.0f);
+
+#endif
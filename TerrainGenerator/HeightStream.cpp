@@ -0,0 +1,117 @@
+#include "HeightStream.h"
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <future>
+#include <unistd.h>
+
+static bool writeAll(int fd, const void *data, size_t size)
+{
+	const char *bytes = (const char*)data;
+	while(size > 0)
+	{
+		ssize_t count = write(fd, bytes, size);
+		if(count < 0 && errno == EINTR)
+			continue;
+		if(count <= 0)
+			return false;
+		bytes += count;
+		size -= (size_t)count;
+	}
+	return true;
+}
+
+RawHeightSink::RawHeightSink(const std::string &path, const std::string &normalsPath) : path(path), normalsPath(normalsPath)
+{
+}
+
+RawHeightSink::~RawHeightSink()
+{
+	close();
+}
+
+void RawHeightSink::close()
+{
+	if(fd >= 0)
+		::close(fd);
+	if(normalsFd >= 0)
+		::close(normalsFd);
+	fd = -1;
+	normalsFd = -1;
+}
+
+bool RawHeightSink::begin(int width, int)
+{
+	close();
+	this->width = width;
+	fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(fd >= 0 && !normalsPath.empty())
+		normalsFd = open(normalsPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0 || (!normalsPath.empty() && normalsFd < 0))
+	{
+		std::cout << "ERROR::HEIGHTSTREAM::COULD_NOT_OPEN " << path << std::endl;
+		close();
+		return false;
+	}
+	// The output is written once front to back and never read again here.
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	return true;
+}
+
+bool RawHeightSink::writeRows(int, int rows, const float *heights, const uint32_t *normals)
+{
+	size_t samples = (size_t)rows * width;
+	if(fd < 0 || !writeAll(fd, heights, samples * sizeof(float)))
+		return false;
+	if(normalsFd < 0)
+		return true;
+	// A stream run without normals would leave the normals file short of the heights.
+	if(!normals)
+	{
+		std::cout << "ERROR::HEIGHTSTREAM::NO_NORMALS " << normalsPath << std::endl;
+		return false;
+	}
+	return writeAll(normalsFd, normals, samples * sizeof(uint32_t));
+}
+
+bool RawHeightSink::finish()
+{
+	bool open = fd >= 0;
+	close();
+	return open;
+}
+
+bool streamHeightMap(TerrainGenerator &generator, int width, int height, double originX, double originY,
+	HeightSink &sink, const StreamSettings &settings)
+{
+	if(width <= 0 || height <= 0 || !sink.begin(width, height))
+		return false;
+
+	size_t rowBytes = (size_t)width * (settings.normals ? sizeof(float) + sizeof(uint32_t) + sizeof(float) : sizeof(float));
+	int bandRows = (int)std::min<size_t>(std::max<size_t>(settings.memoryBudget / (2 * rowBytes), 1), height);
+
+	// While one band is being written the other one is generated.
+	HeightMap bands[2];
+	NormalMap normals[2];
+	std::future<bool> pending;
+	bool ok = true;
+	int current = 0;
+	for(int y = 0; y < height && ok; y += bandRows)
+	{
+		int rows = std::min(bandRows, height - y);
+		HeightMap &band = bands[current];
+		NormalMap *bandNormals = settings.normals ? &normals[current] : nullptr;
+		band.resize(width, rows);
+		generator.GenerateHeightMap(band, originX, originY + y, bandNormals);
+
+		if(pending.valid())
+			ok = pending.get();
+		pending = std::async(std::launch::async, [&sink, &band, bandNormals, y, rows]() {
+			return sink.writeRows(y, rows, band.heights.data(), bandNormals ? bandNormals->normals.data() : nullptr);
+		});
+		current ^= 1;
+	}
+	if(pending.valid())
+		ok = pending.get() && ok;
+	return sink.finish() && ok;
+}
@@ -0,0 +1,56 @@
+#ifndef HEIGHTSTREAM_H
+#define HEIGHTSTREAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "TerrainGenerator.h"
+
+// Receives a streamed map band by band, top to bottom. Each call gets
+// `rows` complete rows starting at map row `y`; `normals` is null unless the
+// stream was asked for them. Returning false aborts the stream.
+class HeightSink
+{
+public:
+	virtual ~HeightSink() {}
+	virtual bool begin(int, int) { return true; }
+	virtual bool writeRows(int y, int rows, const float *heights, const uint32_t *normals) = 0;
+	virtual bool finish() { return true; }
+};
+
+// Row-major float heights in one file, packed normals in an optional second one.
+// With a normals path the stream must be asked for normals, or writeRows fails.
+class RawHeightSink : public HeightSink
+{
+public:
+	RawHeightSink(const std::string &path, const std::string &normalsPath = "");
+	~RawHeightSink();
+
+	bool begin(int width, int height);
+	bool writeRows(int y, int rows, const float *heights, const uint32_t *normals);
+	bool finish();
+
+private:
+	std::string path, normalsPath;
+	int fd = -1, normalsFd = -1;
+	int width = 0;
+
+	void close();
+};
+
+struct StreamSettings
+{
+	// Bytes of band buffers in flight, two bands are alive at any time.
+	size_t memoryBudget = (size_t)128 << 20;
+	bool normals = false;
+};
+
+// Generates a width x height map starting at sample (originX, originY)
+// without ever holding more than two bands of it. Each band is generated
+// in parallel with a one sample halo, so heights and normals match a map
+// generated in one piece, while the previous band is handed to the sink on
+// a writer thread. Returns false if the sink failed.
+bool streamHeightMap(TerrainGenerator &generator, int width, int height, double originX, double originY,
+	HeightSink &sink, const StreamSettings &settings = StreamSettings());
+
+#endif
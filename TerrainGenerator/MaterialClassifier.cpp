@@ -0,0 +1,97 @@
+#include "MaterialClassifier.h"
+#include "ChunkKey.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+MaterialClassifier::MaterialClassifier(const std::vector<MaterialRule> &rules, uint8_t fallback, float maxHeight, float maxSlope)
+{
+	heightScale = HEIGHT_BINS / maxHeight;
+	slopeScale = SLOPE_BINS / maxSlope;
+
+	moistureBins = 1;
+	for(const MaterialRule &rule : rules)
+	{
+		if(rule.minMoisture > 0.0f || rule.maxMoisture < 1.0f)
+			moistureBins = MOISTURE_BINS;
+	}
+
+	// Evaluate the rules once at the centre of every bin.
+	table.resize((size_t)moistureBins * SLOPE_BINS * HEIGHT_BINS);
+	for(int m = 0; m < moistureBins; m++)
+	{
+		float moisture = (m + 0.5f) / moistureBins;
+		for(int s = 0; s < SLOPE_BINS; s++)
+		{
+			float slope = (s + 0.5f) / slopeScale;
+			for(int h = 0; h < HEIGHT_BINS; h++)
+			{
+				float height = (h + 0.5f) / heightScale;
+				uint8_t material = fallback;
+				for(const MaterialRule &rule : rules)
+				{
+					if(height >= rule.minHeight && height < rule.maxHeight
+						&& slope >= rule.minSlope && slope < rule.maxSlope
+						&& moisture >= rule.minMoisture && moisture < rule.maxMoisture)
+					{
+						material = rule.material;
+						break;
+					}
+				}
+				table[((size_t)m * SLOPE_BINS + s) * HEIGHT_BINS + h] = material;
+			}
+		}
+	}
+}
+
+const MaterialClassifier &MaterialClassifier::defaults()
+{
+	const float any = std::numeric_limits<float>::max();
+	static const MaterialClassifier classifier({
+		{ -any, any, 0.016f, any, 0.0f, 1.0f, MATERIAL_ROCK },
+		{ 0.68f, any, -any, any, 0.0f, 1.0f, MATERIAL_SNOW },
+		{ -any, 0.33f, -any, any, 0.0f, 1.0f, MATERIAL_SAND },
+		{ -any, 0.45f, -any, any, 0.0f, 0.35f, MATERIAL_SAND }
+	}, MATERIAL_GRASS);
+	return classifier;
+}
+
+uint8_t MaterialClassifier::classify(float height, float slope, float moisture) const
+{
+	int h = std::min(std::max((int)(height * heightScale), 0), HEIGHT_BINS - 1);
+	int s = std::min(std::max((int)(slope * slopeScale), 0), SLOPE_BINS - 1);
+	int m = std::min(std::max((int)(moisture * moistureBins), 0), moistureBins - 1);
+	return table[((size_t)m * SLOPE_BINS + s) * HEIGHT_BINS + h];
+}
+
+void MaterialClassifier::classifySpan(const float *heights, const float *slopes, const float *moisture, int count, uint8_t *out) const
+{
+	if(!usesMoisture())
+	{
+		for(int i = 0; i < count; i++)
+		{
+			int h = std::min(std::max((int)(heights[i] * heightScale), 0), HEIGHT_BINS - 1);
+			int s = std::min(std::max((int)(slopes[i] * slopeScale), 0), SLOPE_BINS - 1);
+			out[i] = table[s * HEIGHT_BINS + h];
+		}
+		return;
+	}
+	for(int i = 0; i < count; i++)
+		out[i] = classify(heights[i], slopes[i], moisture[i]);
+}
+
+uint64_t MaterialClassifier::hash() const
+{
+	uint32_t scales[2];
+	memcpy(&scales[0], &heightScale, sizeof(float));
+	memcpy(&scales[1], &slopeScale, sizeof(float));
+	uint64_t h = mixBits(((uint64_t)scales[0] << 32) | scales[1]);
+	h = mixBits(h ^ (uint64_t)moistureBins);
+	for(size_t i = 0; i < table.size(); i += 8)
+	{
+		uint64_t word = 0;
+		memcpy(&word, &table[i], std::min<size_t>(8, table.size() - i));
+		h = mixBits(h ^ word);
+	}
+	return h;
+}
@@ -0,0 +1,68 @@
+#ifndef MATERIALCLASSIFIER_H
+#define MATERIALCLASSIFIER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+enum TerrainMaterial
+{
+	MATERIAL_ROCK = 0,
+	MATERIAL_GRASS = 1,
+	MATERIAL_SNOW = 2,
+	MATERIAL_SAND = 3
+};
+
+// One row of the rule table. A sample gets the material of the first rule
+// whose ranges (min inclusive, max exclusive) contain it.
+struct MaterialRule
+{
+	float minHeight, maxHeight;
+	float minSlope, maxSlope;
+	float minMoisture, maxMoisture;
+	uint8_t material;
+};
+
+struct MaterialMap
+{
+	int width = 0, height = 0;
+	std::vector<uint8_t> materials;
+
+	void resize(int w, int h)
+	{
+		width = w;
+		height = h;
+		materials.resize((size_t)w * h);
+	}
+};
+
+// Rule table baked into a height x slope x moisture lookup table, small
+// enough to stay in L1 while the generator classifies a band.
+class MaterialClassifier
+{
+public:
+	MaterialClassifier(const std::vector<MaterialRule> &rules, uint8_t fallback,
+		float maxHeight = 1.0f, float maxSlope = 0.03f);
+
+	// Rock on steep slopes, snow up high, sand on low or dry ground, grass elsewhere.
+	static const MaterialClassifier &defaults();
+
+	// False when no rule looks at moisture, the generator then skips sampling it.
+	bool usesMoisture() const { return moistureBins > 1; }
+	uint8_t classify(float height, float slope, float moisture) const;
+	// `moisture` may be null when usesMoisture() is false.
+	void classifySpan(const float *heights, const float *slopes, const float *moisture, int count, uint8_t *out) const;
+	// Hash of the baked table, equal for classifiers that classify identically.
+	uint64_t hash() const;
+
+private:
+	static const int HEIGHT_BINS = 64;
+	static const int SLOPE_BINS = 32;
+	static const int MOISTURE_BINS = 8;
+
+	float heightScale, slopeScale;
+	int moistureBins;
+	std::vector<uint8_t> table;
+};
+
+#endif
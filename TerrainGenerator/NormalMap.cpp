@@ -0,0 +1,121 @@
+#include "NormalMap.h"
+#include "../Parallel/ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static int16_t toSnorm16(float v)
+{
+	v = std::max(-1.0f, std::min(1.0f, v));
+	return (int16_t)std::lrint(v * 32767.0f);
+}
+
+uint32_t packOctahedral(float x, float y, float z)
+{
+	float invL1 = 1.0f / (std::fabs(x) + std::fabs(y) + std::fabs(z));
+	float px = x * invL1;
+	float py = y * invL1;
+	// Fold the lower hemisphere over the diagonals.
+	if(z < 0.0f)
+	{
+		float fx = (1.0f - std::fabs(py)) * (px >= 0.0f ? 1.0f : -1.0f);
+		float fy = (1.0f - std::fabs(px)) * (py >= 0.0f ? 1.0f : -1.0f);
+		px = fx;
+		py = fy;
+	}
+	return (uint16_t)toSnorm16(px) | ((uint32_t)(uint16_t)toSnorm16(py) << 16);
+}
+
+std::array<float, 3> unpackOctahedral(uint32_t packed)
+{
+	float px = std::max(-1.0f, (int16_t)(packed & 0xffff) / 32767.0f);
+	float py = std::max(-1.0f, (int16_t)(packed >> 16) / 32767.0f);
+	float z = 1.0f - std::fabs(px) - std::fabs(py);
+	if(z < 0.0f)
+	{
+		float fx = (1.0f - std::fabs(py)) * (px >= 0.0f ? 1.0f : -1.0f);
+		float fy = (1.0f - std::fabs(px)) * (py >= 0.0f ? 1.0f : -1.0f);
+		px = fx;
+		py = fy;
+	}
+	float len = std::sqrt(px * px + py * py + z * z);
+	return {{ px / len, py / len, z / len }};
+}
+
+// Normal of a heightfield with gradient (dx, dy) is (-dx, -dy, 1).
+static void packGradient(float dx, float dy, uint32_t *normal, float *slope)
+{
+	*slope = std::sqrt(dx * dx + dy * dy);
+	*normal = packOctahedral(-dx, -dy, 1.0f);
+}
+
+void computeNormalSpan(const float *up, const float *mid, const float *down, int count,
+	float cellSize, float heightScale, uint32_t *normals, float *slopes)
+{
+	float scale = heightScale / (2.0f * cellSize);
+	int x = 0;
+#ifdef __SSE2__
+	const __m128 vscale = _mm_set1_ps(scale);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 snorm = _mm_set1_ps(32767.0f);
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+	for(; x + 4 <= count; x += 4)
+	{
+		__m128 dx = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(mid + x + 1), _mm_loadu_ps(mid + x - 1)), vscale);
+		__m128 dy = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(down + x), _mm_loadu_ps(up + x)), vscale);
+		_mm_storeu_ps(slopes + x, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy))));
+
+		// z is always 1, so the octahedral projection never needs the fold.
+		__m128 l1 = _mm_add_ps(_mm_add_ps(_mm_and_ps(dx, absMask), _mm_and_ps(dy, absMask)), one);
+		__m128 inv = _mm_div_ps(snorm, l1);
+		__m128i px = _mm_cvtps_epi32(_mm_mul_ps(_mm_xor_ps(dx, signMask), inv));
+		__m128i py = _mm_cvtps_epi32(_mm_mul_ps(_mm_xor_ps(dy, signMask), inv));
+		__m128i packed = _mm_unpacklo_epi16(_mm_packs_epi32(px, px), _mm_packs_epi32(py, py));
+		_mm_storeu_si128((__m128i*)(normals + x), packed);
+	}
+#endif
+	for(; x < count; x++)
+	{
+		float dx = (mid[x + 1] - mid[x - 1]) * scale;
+		float dy = (down[x] - up[x]) * scale;
+		packGradient(dx, dy, normals + x, slopes + x);
+	}
+}
+
+void computeNormalMap(const HeightMap &map, NormalMap &out, float cellSize, float heightScale)
+{
+	out.resize(map.width, map.height);
+	if(map.width == 0 || map.height == 0)
+		return;
+
+	int w = map.width, h = map.height;
+	auto edgeSample = [&](int x, int y) {
+		int l = std::max(x - 1, 0), r = std::min(x + 1, w - 1);
+		int u = std::max(y - 1, 0), d = std::min(y + 1, h - 1);
+		float dx = r > l ? (map.at(r, y) - map.at(l, y)) * heightScale / ((r - l) * cellSize) : 0.0f;
+		float dy = d > u ? (map.at(x, d) - map.at(x, u)) * heightScale / ((d - u) * cellSize) : 0.0f;
+		size_t i = (size_t)y * w + x;
+		packGradient(dx, dy, &out.normals[i], &out.slopes[i]);
+	};
+
+	ThreadPool::global().parallelFor(h, 64, [&](int first, int last) {
+		for(int y = first; y < last; y++)
+		{
+			if(y == 0 || y == h - 1 || w < 3)
+			{
+				for(int x = 0; x < w; x++)
+					edgeSample(x, y);
+				continue;
+			}
+			size_t i = (size_t)y * w;
+			computeNormalSpan(map.row(y - 1) + 1, map.row(y) + 1, map.row(y + 1) + 1, w - 2,
+				cellSize, heightScale, &out.normals[i + 1], &out.slopes[i + 1]);
+			edgeSample(0, y);
+			edgeSample(w - 1, y);
+		}
+	});
+}
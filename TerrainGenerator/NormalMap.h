@@ -0,0 +1,41 @@
+#ifndef NORMALMAP_H
+#define NORMALMAP_H
+
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "HeightMap.h"
+
+// Per-sample normals and slopes derived from a heightmap.
+// Normals are octahedral encoded into two snorm16 components: x in the low
+// 16 bits and y in the high 16 bits, so a texel can be uploaded directly as
+// GL_RG16_SNORM or bound as a 2 x GL_SHORT normalized vertex attribute.
+struct NormalMap
+{
+	int width = 0, height = 0;
+	std::vector<uint32_t> normals;
+	// Gradient magnitude (rise over run) of every sample.
+	std::vector<float> slopes;
+
+	void resize(int w, int h)
+	{
+		width = w;
+		height = h;
+		normals.resize((size_t)w * h);
+		slopes.resize((size_t)w * h);
+	}
+};
+
+uint32_t packOctahedral(float x, float y, float z);
+std::array<float, 3> unpackOctahedral(uint32_t packed);
+
+// Central difference normals for `count` samples of one row. `up`, `mid` and
+// `down` point at the first sample of the rows above, at and below the output
+// row and must be readable one sample past both ends of the span.
+void computeNormalSpan(const float *up, const float *mid, const float *down, int count,
+	float cellSize, float heightScale, uint32_t *normals, float *slopes);
+
+// Standalone pass over an existing heightmap, edges use one sided differences.
+void computeNormalMap(const HeightMap &map, NormalMap &out, float cellSize, float heightScale);
+
+#endif
@@ -1,6 +1,6 @@
 #include "PerlinNoise.h"
 #include <cmath>
-#include <random>
+#include <cstdint>
 #include <algorithm>
 #include <numeric>
 
@@ -38,11 +38,18 @@ PerlinNoise::PerlinNoise(unsigned int seed) {
 	// Fill p with values from 0 to 255
 	std::iota(p.begin(), p.end(), 0);
 
-	// Initialize a random engine with seed
-	std::default_random_engine engine(seed);
-
-	// Suffle  using the above random engine
-	std::shuffle(p.begin(), p.end(), engine);
+	// Fisher-Yates shuffle driven by SplitMix64. Unlike std::shuffle with
+	// std::default_random_engine this gives the same table on every standard
+	// library, so a seed describes the same world on every machine.
+	uint64_t state = seed;
+	for(int i = 255; i > 0; i--) {
+		state += 0x9e3779b97f4a7c15ull;
+		uint64_t z = state;
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+		z ^= z >> 31;
+		std::swap(p[i], p[z % (uint64_t)(i + 1)]);
+	}
 
 	// Duplicate the permutation vector
 	p.insert(p.end(), p.begin(), p.end());
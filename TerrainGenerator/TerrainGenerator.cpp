@@ -1,10 +1,50 @@
 #include "TerrainGenerator.h"
+#include "../Parallel/ThreadPool.h"
+#include <algorithm>
+#include <cstring>
 
 const unsigned int NOISE_SEED = 1337;
+// Bump whenever generated output changes without any constant below changing,
+// e.g. a new noise function, so cached chunks are invalidated.
+const uint32_t GENERATOR_VERSION = 1;
+// Noise space distance between neighbouring samples.
+const double SAMPLE_SPACING = 0.02;
+// Moisture varies slower than height and lives on its own noise slice.
+const double MOISTURE_SPACING = 0.005;
+const double MOISTURE_SLICE = 0.5;
+// Moisture is only evaluated every few samples and interpolated in between.
+const int MOISTURE_STEP = 8;
+// World size of one sample step and the scale applied to noise heights.
+const float CELL_SIZE = 1.0f;
+const float HEIGHT_SCALE = 1.0f;
+// Rows generated per task, small enough for a band plus halo to stay in L2.
+const int BAND_ROWS = 32;
 
-TerrainGenerator::TerrainGenerator()
+TerrainGenerator::TerrainGenerator() : TerrainGenerator(NOISE_SEED)
 {
-	nn = PerlinNoise(NOISE_SEED);
+}
+
+TerrainGenerator::TerrainGenerator(unsigned int worldSeed) : nn(worldSeed), worldSeed(worldSeed)
+{
+}
+
+static uint64_t hashDouble(uint64_t h, double value)
+{
+	uint64_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return mixBits(h ^ bits);
+}
+
+uint64_t TerrainGenerator::getParameterHash() const
+{
+	uint64_t h = mixBits(GENERATOR_VERSION);
+	h = mixBits(h ^ worldSeed);
+	h = hashDouble(h, SAMPLE_SPACING);
+	h = hashDouble(h, MOISTURE_SPACING);
+	h = hashDouble(h, MOISTURE_SLICE);
+	h = mixBits(h ^ (uint64_t)MOISTURE_STEP);
+	h = hashDouble(h, CELL_SIZE);
+	return hashDouble(h, HEIGHT_SCALE);
 }
 
 std::vector<std::vector<double>> TerrainGenerator::generate_plane(int width, int height, double z)
@@ -31,14 +71,22 @@ std::vector<std::vector<double>> TerrainGenerator::generate_plane(int width, int
 }
 
 std::vector<std::vector<TerrainQuad>> TerrainGenerator::Generate(int width, int height, double quadSize, double zOffset)
+{
+	std::vector<std::vector<TerrainQuad>> result;
+	Generate(width, height, quadSize, zOffset, result);
+	return result;
+}
+
+void TerrainGenerator::Generate(int width, int height, double quadSize, double zOffset, std::vector<std::vector<TerrainQuad>> &result)
 {
 	double power = 0.6;
 	double yOff = zOffset;
 	int y = 0;
-	std::vector<std::vector<TerrainQuad>> result;
+	result.resize((int)(height / quadSize));
 	while(y < (int)(height / quadSize))
 	{
-		std::vector<TerrainQuad> row;
+		std::vector<TerrainQuad> &row = result[y];
+		row.clear();
 		int x = 0;
 		double xOff = 0.0f;
 		while(x < (int)(width / quadSize))
@@ -55,11 +103,124 @@ std::vector<std::vector<TerrainQuad>> TerrainGenerator::Generate(int width, int
 			x += 1;
 			xOff += 0.02;
 		}
-		result.push_back(row);
 		y += 1;
 		yOff += 0.02;
 	}
-	return result;
+}
+
+void TerrainGenerator::GenerateHeights(double originX, double originY, int width, int height, float *out, int stride, double step)
+{
+	for(int y = 0; y < height; y++)
+	{
+		double yOff = (originY + y * step) * SAMPLE_SPACING;
+		float *row = out + (size_t)y * stride;
+		for(int x = 0; x < width; x++)
+		{
+			row[x] = (float)nn.noise((originX + x * step) * SAMPLE_SPACING, yOff, 0);
+		}
+	}
+}
+
+void TerrainGenerator::GenerateMoisture(double originX, double originY, int width, float *out, double step)
+{
+	double yOff = originY * MOISTURE_SPACING;
+	float right = (float)nn.noise(originX * MOISTURE_SPACING, yOff, MOISTURE_SLICE);
+	for(int x0 = 0; x0 < width; x0 += MOISTURE_STEP)
+	{
+		float left = right;
+		right = (float)nn.noise((originX + (x0 + MOISTURE_STEP) * step) * MOISTURE_SPACING, yOff, MOISTURE_SLICE);
+		int count = std::min(MOISTURE_STEP, width - x0);
+		for(int i = 0; i < count; i++)
+		{
+			out[x0 + i] = left + (right - left) * ((float)i / MOISTURE_STEP);
+		}
+	}
+}
+
+HeightMap TerrainGenerator::GenerateHeightMap(int width, int height, double originX, double originY, NormalMap *normals,
+	MaterialMap *materials, const MaterialClassifier *classifier)
+{
+	HeightMap map(width, height);
+	GenerateHeightMap(map, originX, originY, normals, materials, classifier);
+	return map;
+}
+
+void TerrainGenerator::GenerateHeightMap(HeightMap &map, double originX, double originY, NormalMap *normals,
+	MaterialMap *materials, const MaterialClassifier *classifier)
+{
+	GenerateBands(map, originX, originY, 1.0, normals, materials, classifier);
+}
+
+void TerrainGenerator::GenerateChunk(const ChunkKey &key, int chunkSize, HeightMap &map, NormalMap *normals,
+	MaterialMap *materials, const MaterialClassifier *classifier)
+{
+	double step = std::ldexp(1.0, key.lod);
+	map.resize(chunkSize + 1, chunkSize + 1);
+	GenerateBands(map, (double)key.x * chunkSize * step, (double)key.y * chunkSize * step, step, normals, materials, classifier);
+}
+
+void TerrainGenerator::GenerateBands(HeightMap &map, double originX, double originY, double step, NormalMap *normals,
+	MaterialMap *materials, const MaterialClassifier *classifier)
+{
+	int width = map.width, height = map.height;
+	map.resize(width, height);
+	if(normals)
+		normals->resize(width, height);
+	if(materials)
+	{
+		materials->resize(width, height);
+		if(!classifier)
+			classifier = &MaterialClassifier::defaults();
+	}
+
+	int bands = (height + BAND_ROWS - 1) / BAND_ROWS;
+	ThreadPool::global().parallelFor(bands, 1, [&](int first, int last) {
+		static thread_local std::vector<float> scratch;
+		static thread_local std::vector<float> rowSlopes;
+		static thread_local std::vector<uint32_t> rowNormals;
+		static thread_local std::vector<float> rowMoisture;
+		for(int band = first; band < last; band++)
+		{
+			int y0 = band * BAND_ROWS;
+			int rows = std::min(BAND_ROWS, height - y0);
+			if(!normals && !materials)
+			{
+				GenerateHeights(originX, originY + y0 * step, width, rows, map.row(y0), width, step);
+				continue;
+			}
+
+			// Generate the band with a one sample halo so normals at the band and
+			// map edges see real neighbours instead of clamped ones.
+			int stride = width + 2;
+			scratch.resize((size_t)stride * (rows + 2));
+			GenerateHeights(originX - step, originY + (y0 - 1) * step, stride, rows + 2, scratch.data(), stride, step);
+			if(!normals)
+			{
+				rowNormals.resize(width);
+				rowSlopes.resize(width);
+			}
+			for(int r = 0; r < rows; r++)
+			{
+				const float *mid = scratch.data() + (size_t)(r + 1) * stride + 1;
+				std::copy(mid, mid + width, map.row(y0 + r));
+				size_t i = (size_t)(y0 + r) * width;
+				uint32_t *normalRow = normals ? &normals->normals[i] : rowNormals.data();
+				float *slopeRow = normals ? &normals->slopes[i] : rowSlopes.data();
+				computeNormalSpan(mid - stride, mid, mid + stride, width, CELL_SIZE * (float)step, HEIGHT_SCALE, normalRow, slopeRow);
+				if(materials)
+				{
+					const float *moisture = nullptr;
+					if(classifier->usesMoisture())
+					{
+						rowMoisture.resize(width);
+						GenerateMoisture(originX, originY + (y0 + r) * step, width, rowMoisture.data(), step);
+						moisture = rowMoisture.data();
+					}
+					classifier->classifySpan(mid, slopeRow, moisture, width, &materials->materials[i]);
+				}
+			}
+		}
+	});
 }
 
 TerrainQuad::TerrainQuad(double posX, double posY, double s)
@@ -5,6 +5,10 @@
 #include <array>
 #include <cmath>
 #include "PerlinNoise.h"
+#include "HeightMap.h"
+#include "NormalMap.h"
+#include "MaterialClassifier.h"
+#include "ChunkKey.h"
 
 class TerrainQuad
 {
@@ -19,11 +23,42 @@ class TerrainGenerator
 {
 private:
 	PerlinNoise nn;
+	unsigned int worldSeed;
 	int y;
+
+	void GenerateBands(HeightMap &map, double originX, double originY, double step, NormalMap *normals,
+		MaterialMap *materials, const MaterialClassifier *classifier);
 public:
 	TerrainGenerator();
+	TerrainGenerator(unsigned int worldSeed);
+	unsigned int getWorldSeed() const { return worldSeed; }
+	// Hash of the generator version, its constants and the seed. Anything
+	// cached from this generator is valid exactly while the hash is unchanged.
+	uint64_t getParameterHash() const;
 	std::vector<std::vector<double>> generate_plane(int width, int height, double z);
 	std::vector<std::vector<TerrainQuad>> Generate(int, int, double, double);
+	// Same as above but refills `result`, keeping the storage of its rows.
+	void Generate(int, int, double, double, std::vector<std::vector<TerrainQuad>> &result);
+
+	// Fills a width x height window of samples starting at sample (originX, originY),
+	// `step` world samples apart. `out` is row-major with `stride` floats per row.
+	void GenerateHeights(double originX, double originY, int width, int height, float *out, int stride, double step = 1.0);
+	// Generates the window in parallel row bands. When `normals` is given the
+	// normals and slopes are computed from each band while it is still in cache.
+	// When `materials` is given every sample is also classified in the same
+	// band loop, with the default rules unless a classifier is passed.
+	HeightMap GenerateHeightMap(int width, int height, double originX, double originY, NormalMap *normals = nullptr,
+		MaterialMap *materials = nullptr, const MaterialClassifier *classifier = nullptr);
+	// Fills `map` at its current size, reusing its buffers (e.g. ones taken from a ChunkPool).
+	void GenerateHeightMap(HeightMap &map, double originX, double originY, NormalMap *normals = nullptr,
+		MaterialMap *materials = nullptr, const MaterialClassifier *classifier = nullptr);
+	// Low frequency moisture field in [0, 1] used by material classification.
+	void GenerateMoisture(double originX, double originY, int width, float *out, double step = 1.0);
+	// Generates chunk `key` as (chunkSize + 1)^2 samples. The result depends only
+	// on the world seed, the key and chunkSize, never on what was generated before,
+	// and neighbouring chunks of the same LOD share their edge samples.
+	void GenerateChunk(const ChunkKey &key, int chunkSize, HeightMap &map, NormalMap *normals = nullptr,
+		MaterialMap *materials = nullptr, const MaterialClassifier *classifier = nullptr);
 };
 
 
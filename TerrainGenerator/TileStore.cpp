@@ -0,0 +1,213 @@
+#include "TileStore.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+const char TILE_STORE_MAGIC[8] = { 'E', 'X', 'P', 'T', 'I', 'L', 'E', 'S' };
+const uint32_t TILE_STORE_VERSION = 2;
+
+static size_t alignToPage(size_t size)
+{
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	return (size + page - 1) / page * page;
+}
+
+// FNV-1a over the sample bits, never 0 so it doubles as the generated flag.
+static uint32_t tileChecksum(const float *heights, size_t count)
+{
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for(size_t i = 0; i < count; i++)
+	{
+		uint32_t bits;
+		memcpy(&bits, heights + i, sizeof(bits));
+		hash = (hash ^ bits) * 0x100000001b3ull;
+	}
+	return (uint32_t)(hash ^ (hash >> 32)) | 1u;
+}
+
+TileStore::TileStore(const std::string &path, TerrainGenerator &generator, int tileSize, int tilesX, int tilesY)
+	: generator(generator), tileSize(tileSize), tilesX(tilesX), tilesY(tilesY)
+{
+	// Page aligned tiles so madvise can target single tiles.
+	tileBytes = alignToPage((size_t)tileSize * tileSize * sizeof(float));
+	if(tileSize <= 0 || tilesX <= 0 || tilesY <= 0 || !mapFile(path))
+	{
+		std::cout << "ERROR::TILESTORE::COULD_NOT_OPEN " << path << std::endl;
+		close();
+	}
+}
+
+TileStore::~TileStore()
+{
+	close();
+}
+
+bool TileStore::mapFile(const std::string &path)
+{
+	size_t tileCount = (size_t)tilesX * tilesY;
+	size_t indexOffset = alignToPage(sizeof(Header));
+	size_t dataOffset = indexOffset + alignToPage(tileCount * sizeof(uint32_t));
+	size_t fileSize = dataOffset + tileCount * tileBytes;
+
+	fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+	if(fd < 0)
+		return false;
+
+	struct stat info;
+	if(fstat(fd, &info) != 0)
+		return false;
+	bool fresh = info.st_size == 0;
+	bool reset = false;
+	if(!fresh)
+	{
+		Header header;
+		if((size_t)info.st_size != fileSize || pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header))
+			return false;
+		// A crash between sizing the file and writing the header leaves it all zero.
+		static const Header empty = {};
+		if(memcmp(&header, &empty, sizeof(header)) == 0)
+			reset = true;
+		else if(memcmp(header.magic, TILE_STORE_MAGIC, sizeof(TILE_STORE_MAGIC)) != 0
+			|| header.tileSize != (uint32_t)tileSize
+			|| header.tilesX != (uint32_t)tilesX
+			|| header.tilesY != (uint32_t)tilesY
+			|| header.indexOffset != indexOffset
+			|| header.dataOffset != dataOffset)
+		{
+			return false;
+		}
+		// Tiles of an older layout or of a generator with other parameters are stale.
+		else if(header.version != TILE_STORE_VERSION || header.parameterHash != generator.getParameterHash())
+			reset = true;
+	}
+	// Cutting the file back to nothing drops every stale tile and index word at once.
+	if(reset && ftruncate(fd, 0) != 0)
+		return false;
+	fresh = fresh || reset;
+	// Tiles that were never touched stay holes in a sparse file.
+	if(fresh && ftruncate(fd, (off_t)fileSize) != 0)
+		return false;
+
+	void *mapping = mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if(mapping == MAP_FAILED)
+		return false;
+	data = (unsigned char*)mapping;
+	mappedSize = fileSize;
+
+	if(fresh)
+	{
+		Header *header = (Header*)data;
+		memcpy(header->magic, TILE_STORE_MAGIC, sizeof(TILE_STORE_MAGIC));
+		header->version = TILE_STORE_VERSION;
+		header->tileSize = tileSize;
+		header->tilesX = tilesX;
+		header->tilesY = tilesY;
+		header->indexOffset = indexOffset;
+		header->dataOffset = dataOffset;
+		header->parameterHash = generator.getParameterHash();
+	}
+
+	index = (uint32_t*)(data + indexOffset);
+	tiles = data + dataOffset;
+	verified.assign(tileCount, TILE_UNCHECKED);
+	return true;
+}
+
+void TileStore::close()
+{
+	if(data)
+	{
+		// Let the page cache write the tiles back without blocking exit.
+		msync(data, mappedSize, MS_ASYNC);
+		munmap(data, mappedSize);
+	}
+	if(fd >= 0)
+		::close(fd);
+	data = nullptr;
+	index = nullptr;
+	tiles = nullptr;
+	verified.clear();
+	fd = -1;
+}
+
+const float *TileStore::tile(int tx, int ty)
+{
+	if(!data || tx < 0 || ty < 0 || tx >= tilesX || ty >= tilesY)
+		return nullptr;
+
+	size_t i = (size_t)ty * tilesX + tx;
+	float *heights = (float*)(tiles + i * tileBytes);
+	if(__atomic_load_n(&verified[i], __ATOMIC_ACQUIRE) == TILE_READY)
+		return heights;
+
+	// The thread that claims the tile generates it, others touching the same
+	// tile wait for it, and different tiles generate in parallel.
+	uint8_t unchecked = TILE_UNCHECKED;
+	if(__atomic_compare_exchange_n(&verified[i], &unchecked, (uint8_t)TILE_CLAIMED, false,
+		__ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+	{
+		// A tile from an earlier session is regenerated unless its pages made it to disk with it.
+		size_t samples = (size_t)tileSize * tileSize;
+		uint32_t stored = __atomic_load_n(&index[i], __ATOMIC_ACQUIRE);
+		if(stored == 0 || tileChecksum(heights, samples) != stored)
+		{
+			generator.GenerateHeights((double)tx * tileSize, (double)ty * tileSize, tileSize, tileSize, heights, tileSize);
+			__atomic_store_n(&index[i], tileChecksum(heights, samples), __ATOMIC_RELEASE);
+		}
+		__atomic_store_n(&verified[i], (uint8_t)TILE_READY, __ATOMIC_RELEASE);
+	}
+	else
+	{
+		while(__atomic_load_n(&verified[i], __ATOMIC_ACQUIRE) != TILE_READY)
+			std::this_thread::yield();
+	}
+	return heights;
+}
+
+bool TileStore::isGenerated(int tx, int ty) const
+{
+	if(!data || tx < 0 || ty < 0 || tx >= tilesX || ty >= tilesY)
+		return false;
+	return __atomic_load_n(&index[(size_t)ty * tilesX + tx], __ATOMIC_ACQUIRE) != 0;
+}
+
+void TileStore::adviseSequential()
+{
+	if(data)
+		madvise(tiles, (size_t)tilesX * tilesY * tileBytes, MADV_SEQUENTIAL);
+}
+
+void TileStore::adviseRandom()
+{
+	if(data)
+		madvise(tiles, (size_t)tilesX * tilesY * tileBytes, MADV_RANDOM);
+}
+
+void TileStore::prefetch(int tx0, int ty0, int tx1, int ty1)
+{
+	if(!data)
+		return;
+	tx0 = std::max(tx0, 0);
+	ty0 = std::max(ty0, 0);
+	tx1 = std::min(tx1, tilesX - 1);
+	ty1 = std::min(ty1, tilesY - 1);
+	for(int ty = ty0; ty <= ty1; ty++)
+	{
+		for(int tx = tx0; tx <= tx1; tx++)
+		{
+			// Only generated tiles have anything on disk worth reading.
+			if(isGenerated(tx, ty))
+				madvise(tiles + ((size_t)ty * tilesX + tx) * tileBytes, tileBytes, MADV_WILLNEED);
+		}
+	}
+}
+
+void TileStore::flush()
+{
+	if(data)
+		msync(data, mappedSize, MS_SYNC);
+}
@@ -0,0 +1,72 @@
+#ifndef TILESTORE_H
+#define TILESTORE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "TerrainGenerator.h"
+
+// Heightmap tiles backed by a memory mapped file.
+// The file starts with a header and an index holding one checksum word per
+// tile (0 while the tile was never generated), followed by the tiles
+// themselves. A tile is generated the first time it is touched and written
+// back by the OS page cache, so reopening the same file makes previously
+// explored regions available without regenerating them. The page cache may
+// write the index and the tiles back in any order, so a stored tile is only
+// trusted once its checksum matches, and a store written by a generator with
+// other parameters is emptied when opened.
+class TileStore
+{
+public:
+	TileStore(const std::string &path, TerrainGenerator &generator, int tileSize, int tilesX, int tilesY);
+	~TileStore();
+
+	bool isOpen() const { return data != nullptr; }
+	int getTileSize() const { return tileSize; }
+	int getTilesX() const { return tilesX; }
+	int getTilesY() const { return tilesY; }
+
+	// Heights of tile (tx, ty), row-major tileSize x tileSize samples.
+	// Returns nullptr for tiles outside the store.
+	const float *tile(int tx, int ty);
+	// True once the tile was generated, by this or an earlier session.
+	bool isGenerated(int tx, int ty) const;
+
+	// Access pattern hints for the whole tile area.
+	void adviseSequential();
+	void adviseRandom();
+	// Ask the kernel to start reading the tiles of a rectangle ahead of use.
+	void prefetch(int tx0, int ty0, int tx1, int ty1);
+	// Synchronously writes dirty pages back to the file.
+	void flush();
+
+private:
+	struct Header
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t tileSize;
+		uint32_t tilesX, tilesY;
+		uint64_t indexOffset;
+		uint64_t dataOffset;
+		uint64_t parameterHash;
+	};
+
+	TerrainGenerator &generator;
+	int tileSize, tilesX, tilesY;
+	int fd = -1;
+	size_t mappedSize = 0;
+	size_t tileBytes = 0;
+	unsigned char *data = nullptr;
+	uint32_t *index = nullptr;
+	unsigned char *tiles = nullptr;
+	// Per tile: TILE_UNCHECKED, TILE_CLAIMED while one thread checks or
+	// generates it, TILE_READY once its heights can be used this session.
+	enum TileState : uint8_t { TILE_UNCHECKED, TILE_CLAIMED, TILE_READY };
+	std::vector<uint8_t> verified;
+
+	bool mapFile(const std::string &path);
+	void close();
+};
+
+#endif
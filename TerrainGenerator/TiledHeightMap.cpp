@@ -0,0 +1,132 @@
+#include "TiledHeightMap.h"
+#include <algorithm>
+
+void TiledHeightMap::fromLinear(const HeightMap &linear)
+{
+	resize(linear.width, linear.height);
+	ThreadPool::global().parallelFor(tilesX * tilesY, 1, [&](int first, int last) {
+		for(int i = first; i < last; i++)
+		{
+			int x0 = (i % tilesX) << TILE_SHIFT, y0 = (i / tilesX) << TILE_SHIFT;
+			int columns = std::min(TILE_SIZE, width - x0), rows = std::min(TILE_SIZE, height - y0);
+			float *out = &samples[(size_t)i * TILE_SAMPLES];
+			for(int r = 0; r < rows; r++)
+			{
+				const float *source = linear.row(y0 + r) + x0;
+				std::copy(source, source + columns, out + r * TILE_SIZE);
+			}
+		}
+	});
+}
+
+void TiledHeightMap::toLinear(HeightMap &linear) const
+{
+	linear.resize(width, height);
+	ThreadPool::global().parallelFor(tilesX * tilesY, 1, [&](int first, int last) {
+		for(int i = first; i < last; i++)
+		{
+			int x0 = (i % tilesX) << TILE_SHIFT, y0 = (i / tilesX) << TILE_SHIFT;
+			int columns = std::min(TILE_SIZE, width - x0), rows = std::min(TILE_SIZE, height - y0);
+			const float *source = &samples[(size_t)i * TILE_SAMPLES];
+			for(int r = 0; r < rows; r++)
+				std::copy(source + r * TILE_SIZE, source + r * TILE_SIZE + columns, linear.row(y0 + r) + x0);
+		}
+	});
+}
+
+float TiledHeightMap::reflected(int x, int y) const
+{
+	if(y < 0 || y >= height)
+	{
+		int edge = y < 0 ? 0 : height - 1;
+		int mirror = y < 0 ? std::min(-y, height - 1) : std::max(2 * (height - 1) - y, 0);
+		return 2.0f * reflected(x, edge) - reflected(x, mirror);
+	}
+	if(x < 0 || x >= width)
+	{
+		int edge = x < 0 ? 0 : width - 1;
+		int mirror = x < 0 ? std::min(-x, width - 1) : std::max(2 * (width - 1) - x, 0);
+		return 2.0f * at(edge, y) - at(mirror, y);
+	}
+	return at(x, y);
+}
+
+void TiledHeightMap::gatherTile(int tx, int ty, int halo, float *out) const
+{
+	const int stride = TILE_SIZE + 2 * halo;
+	const int x0 = (tx << TILE_SHIFT) - halo, y0 = (ty << TILE_SHIFT) - halo;
+	if(x0 < 0 || y0 < 0 || x0 + stride > width || y0 + stride > height)
+	{
+		// Edge tiles take the slow path through the reflection.
+		for(int r = 0; r < stride; r++)
+		{
+			for(int c = 0; c < stride; c++)
+				out[(size_t)r * stride + c] = reflected(x0 + c, y0 + r);
+		}
+		return;
+	}
+	// Interior tiles copy three runs per row: the end of the left neighbour's
+	// row, the tile's own row and the start of the right neighbour's row.
+	for(int r = 0; r < stride; r++)
+	{
+		int y = y0 + r;
+		const float *middle = tile(tx, y >> TILE_SHIFT) + ((y & TILE_MASK) << TILE_SHIFT);
+		float *row = out + (size_t)r * stride;
+		if(halo > 0)
+		{
+			std::copy(middle - TILE_SAMPLES + TILE_SIZE - halo, middle - TILE_SAMPLES + TILE_SIZE, row);
+			std::copy(middle + TILE_SAMPLES, middle + TILE_SAMPLES + halo, row + halo + TILE_SIZE);
+		}
+		std::copy(middle, middle + TILE_SIZE, row + halo);
+	}
+}
+
+void TiledHeightMap::gatherRow(int y, int halo, float *out) const
+{
+	if(y < 0 || y >= height || halo > width)
+	{
+		for(int x = -halo; x < width + halo; x++)
+			out[x + halo] = reflected(x, y);
+		return;
+	}
+	for(int tx = 0; tx < tilesX; tx++)
+	{
+		const float *source = tile(tx, y >> TILE_SHIFT) + ((y & TILE_MASK) << TILE_SHIFT);
+		int x0 = tx << TILE_SHIFT;
+		std::copy(source, source + std::min(TILE_SIZE, width - x0), out + halo + x0);
+	}
+	for(int i = 1; i <= halo; i++)
+	{
+		out[halo - i] = reflected(-i, y);
+		out[halo + width - 1 + i] = reflected(width - 1 + i, y);
+	}
+}
+
+void computeNormalMap(const TiledHeightMap &map, NormalMap &out, float cellSize, float heightScale)
+{
+	out.resize(map.width, map.height);
+	if(map.width == 0 || map.height == 0)
+		return;
+	const int stride = map.width + 2;
+	ThreadPool::global().parallelFor(map.tilesY, 1, [&](int first, int last) {
+		static thread_local std::vector<float> window;
+		window.resize((size_t)stride * 3);
+		for(int ty = first; ty < last; ty++)
+		{
+			int y0 = ty << TiledHeightMap::TILE_SHIFT;
+			int y1 = std::min(y0 + TiledHeightMap::TILE_SIZE, map.height);
+			// Row y lives in slot (y + 1) % 3.
+			map.gatherRow(y0 - 1, 1, &window[(size_t)(y0 % 3) * stride]);
+			map.gatherRow(y0, 1, &window[(size_t)((y0 + 1) % 3) * stride]);
+			for(int y = y0; y < y1; y++)
+			{
+				map.gatherRow(y + 1, 1, &window[(size_t)((y + 2) % 3) * stride]);
+				const float *up = &window[(size_t)(y % 3) * stride + 1];
+				const float *mid = &window[(size_t)((y + 1) % 3) * stride + 1];
+				const float *down = &window[(size_t)((y + 2) % 3) * stride + 1];
+				size_t i = (size_t)y * map.width;
+				computeNormalSpan(up, mid, down, map.width, cellSize, heightScale, &out.normals[i], &out.slopes[i]);
+			}
+		}
+	});
+}
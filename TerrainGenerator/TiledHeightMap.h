@@ -0,0 +1,92 @@
+#ifndef TILEDHEIGHTMAP_H
+#define TILEDHEIGHTMAP_H
+
+#include <cstddef>
+#include <vector>
+#include "HeightMap.h"
+#include "NormalMap.h"
+#include "../Parallel/ThreadPool.h"
+
+// Height samples stored as 64x64 tiles, each tile contiguous and row-major
+// inside, tiles row-major over the map. A tile is 16 KiB, four pages, so a
+// 2D stencil over it stays within a handful of cache lines and TLB entries
+// per row instead of one page per row of a large row-major map. Maps that
+// are not a multiple of 64 are padded, the padding is never read through
+// the accessors below.
+struct TiledHeightMap
+{
+	static const int TILE_SHIFT = 6;
+	static const int TILE_SIZE = 1 << TILE_SHIFT;
+	static const int TILE_MASK = TILE_SIZE - 1;
+	static const int TILE_SAMPLES = TILE_SIZE * TILE_SIZE;
+
+	int width = 0, height = 0;
+	int tilesX = 0, tilesY = 0;
+	std::vector<float> samples;
+
+	TiledHeightMap() {}
+	TiledHeightMap(int w, int h) { resize(w, h); }
+	explicit TiledHeightMap(const HeightMap &linear) { fromLinear(linear); }
+
+	void resize(int w, int h)
+	{
+		width = w;
+		height = h;
+		tilesX = (w + TILE_MASK) >> TILE_SHIFT;
+		tilesY = (h + TILE_MASK) >> TILE_SHIFT;
+		samples.resize((size_t)tilesX * tilesY * TILE_SAMPLES);
+	}
+
+	size_t index(int x, int y) const
+	{
+		size_t tile = (size_t)(y >> TILE_SHIFT) * tilesX + (x >> TILE_SHIFT);
+		return (tile << (2 * TILE_SHIFT)) + ((y & TILE_MASK) << TILE_SHIFT) + (x & TILE_MASK);
+	}
+	float &at(int x, int y) { return samples[index(x, y)]; }
+	float at(int x, int y) const { return samples[index(x, y)]; }
+	float *tile(int tx, int ty) { return &samples[((size_t)ty * tilesX + tx) * TILE_SAMPLES]; }
+	const float *tile(int tx, int ty) const { return &samples[((size_t)ty * tilesX + tx) * TILE_SAMPLES]; }
+
+	// Conversions to and from row-major, e.g. for upload. Both run per tile in parallel.
+	void fromLinear(const HeightMap &linear);
+	void toLinear(HeightMap &linear) const;
+
+	// Copies tile (tx, ty) with `halo` samples around it (at most TILE_SIZE)
+	// into `out`, TILE_SIZE + 2 * halo floats per row. Samples past the map
+	// edge are odd reflections, 2 * edge - mirror, so central differences at
+	// the edge come out as one-sided ones.
+	void gatherTile(int tx, int ty, int halo, float *out) const;
+	// Copies row y with `halo` reflected samples on both ends, y may lie past
+	// the map edge as well.
+	void gatherRow(int y, int halo, float *out) const;
+
+	// Runs f(tx, ty, block, stride) for every tile in parallel, where `block`
+	// points at the tile's first sample inside a gathered copy with `halo`
+	// samples around it and `stride` floats per row.
+	template <class F>
+	void forEachTile(int halo, F f) const
+	{
+		const int stride = TILE_SIZE + 2 * halo;
+		ThreadPool::global().parallelFor(tilesX * tilesY, 1, [&](int first, int last) {
+			static thread_local std::vector<float> block;
+			block.resize((size_t)stride * stride);
+			for(int i = first; i < last; i++)
+			{
+				int tx = i % tilesX, ty = i / tilesX;
+				gatherTile(tx, ty, halo, block.data());
+				f(tx, ty, (const float*)block.data() + (size_t)halo * stride + halo, stride);
+			}
+		});
+	}
+
+private:
+	float reflected(int x, int y) const;
+};
+
+// Same result as computeNormalMap on the linear map. The output stays
+// row-major so it can be uploaded as is, so rather than going tile by tile
+// (which scatters the writes over 64 output rows at a time) each task walks
+// one row of tiles with a rolling window of three gathered rows.
+void computeNormalMap(const TiledHeightMap &map, NormalMap &out, float cellSize, float heightScale);
+
+#endif
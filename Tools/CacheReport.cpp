@@ -0,0 +1,40 @@
+#include "../Renderer/TerrainMesh.h"
+#include "../Renderer/VertexCache.h"
+#include <cstdio>
+
+// Prints the vertex cache statistics of the terrain index buffers before and
+// after optimizeVertexCache, at a few cache sizes.
+
+void report(const char *name, const std::vector<uint32_t> &indices, size_t vertexCount)
+{
+	std::vector<uint32_t> optimized = indices;
+	optimizeVertexCache(optimized.data(), optimized.size(), vertexCount);
+	for(int cacheSize : { 16, 32, 64 })
+	{
+		VertexCacheStats before = measureVertexCache(indices.data(), indices.size(), vertexCount, cacheSize);
+		VertexCacheStats after = measureVertexCache(optimized.data(), optimized.size(), vertexCount, cacheSize);
+		printf("%-24s %6zu tris  cache %2d  ACMR %.3f -> %.3f  ATVR %.3f -> %.3f\n", name, indices.size() / 3,
+			cacheSize, before.acmr, after.acmr, before.atvr, after.atvr);
+	}
+}
+
+int main()
+{
+	const size_t chunkVertices = (size_t)(CHUNK_QUADS + 1) * (CHUNK_QUADS + 1);
+	std::vector<uint32_t> indices;
+	char name[64];
+	for(int lod = 0; (CHUNK_QUADS >> lod) >= 4; lod++)
+	{
+		for(int mask : { 0, EDGE_MIN_X | EDGE_MAX_Y })
+		{
+			buildStitchedGridIndices(CHUNK_QUADS, lod, mask, indices);
+			snprintf(name, sizeof(name), "chunk %d lod %d mask %d", CHUNK_QUADS, lod, mask);
+			report(name, indices, chunkVertices);
+		}
+	}
+	// The displaced grid, VIEW_ROWS quads wide and VIEW_ROWS + 1 deep.
+	buildGridIndices(VIEW_ROWS, VIEW_ROWS + 1, indices);
+	snprintf(name, sizeof(name), "displaced grid %dx%d", VIEW_ROWS, VIEW_ROWS + 1);
+	report(name, indices, (size_t)(VIEW_ROWS + 1) * (VIEW_ROWS + 2));
+	return 0;
+}
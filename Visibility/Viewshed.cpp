@@ -0,0 +1,130 @@
+#include "Viewshed.h"
+#include "../Parallel/ThreadPool.h"
+#include <algorithm>
+#include <limits>
+
+int Viewshed::visibleCount() const
+{
+	int count = 0;
+	for(uint64_t word : bits)
+		count += __builtin_popcountll(word);
+	return count;
+}
+
+void computeViewshed(const HeightMap &map, const Observer &observer, Viewshed &out)
+{
+	const int ox = observer.x, oy = observer.y;
+	out.x0 = std::max(ox - observer.radius, 0);
+	out.y0 = std::max(oy - observer.radius, 0);
+	int x1 = std::min(ox + observer.radius, map.width - 1);
+	int y1 = std::min(oy + observer.radius, map.height - 1);
+	out.width = std::max(x1 - out.x0 + 1, 0);
+	out.height = std::max(y1 - out.y0 + 1, 0);
+	out.wordsPerRow = (out.width + 63) / 64;
+	out.bits.assign((size_t)out.wordsPerRow * out.height, 0);
+	if(ox < 0 || oy < 0 || ox >= map.width || oy >= map.height || observer.radius < 0)
+		return;
+
+	// Height of the sight line over every sample of the window: the terrain,
+	// or the lowest height still visible there if that is higher.
+	static thread_local std::vector<float> sight;
+	const int width = out.width;
+	sight.resize((size_t)width * out.height);
+	const int left = ox - out.x0, top = oy - out.y0;
+	float *origin = &sight[(size_t)top * width + left];
+	const float eye = map.at(ox, oy) + observer.eyeHeight;
+	origin[0] = eye;
+
+	auto markVisible = [&](int dx, int dy) {
+		int x = left + dx, y = top + dy;
+		out.bits[(size_t)y * out.wordsPerRow + (x >> 6)] |= 1ull << (x & 63);
+	};
+	markVisible(0, 0);
+
+	const int height = out.height;
+	const float target = observer.targetHeight;
+	auto settle = [&](int dx, int dy, float inner) {
+		float terrain = map.at(ox + dx, oy + dy);
+		if(terrain + target >= inner)
+			markVisible(dx, dy);
+		origin[(ptrdiff_t)dy * width + dx] = std::max(terrain, inner);
+	};
+
+	// Ring 1 sees the eye directly.
+	for(int dy = std::max(-1, -top); dy <= std::min(1, height - 1 - top); dy++)
+	{
+		for(int dx = std::max(-1, -left); dx <= std::min(1, width - 1 - left); dx++)
+		{
+			if(dx != 0 || dy != 0)
+				settle(dx, dy, -std::numeric_limits<float>::infinity());
+		}
+	}
+
+	const int rings = std::max(std::max(left, width - 1 - left), std::max(top, height - 1 - top));
+	for(int k = 2; k <= rings; k++)
+	{
+		// The ray to offset d on ring k crosses ring k - 1 at d * (k - 1) / k,
+		// and the sight line climbs by k / (k - 1) over the rest of the way.
+		// Crossings are tracked as floor and remainder in integers, stepping
+		// by k - 1 per sample, so ring corners land exactly on ring k - 1.
+		const float inverseK = 1.0f / k;
+		const float climb = (float)k / (k - 1);
+		const int dxMin = std::max(-k, -left), dxMax = std::min(k, width - 1 - left);
+		const int dyMin = std::max(-k, -top), dyMax = std::min(k, height - 1 - top);
+		auto floorDiv = [k](int a) { return a >= 0 ? a / k : -((-a + k - 1) / k); };
+
+		// Top and bottom rows interpolate along row dy -/+ 1.
+		for(int dy = -k; dy <= k; dy += 2 * k)
+		{
+			if(dy < dyMin || dy > dyMax)
+				continue;
+			const float *inner = origin + (ptrdiff_t)(dy > 0 ? dy - 1 : dy + 1) * width;
+			int cross = floorDiv(dxMin * (k - 1));
+			int remainder = dxMin * (k - 1) - cross * k;
+			for(int dx = dxMin; dx <= dxMax; dx++)
+			{
+				float z = inner[cross];
+				if(remainder > 0)
+					z += (inner[cross + 1] - z) * (remainder * inverseK);
+				settle(dx, dy, eye + (z - eye) * climb);
+				remainder += k - 1;
+				if(remainder >= k)
+				{
+					remainder -= k;
+					cross++;
+				}
+			}
+		}
+		// Side columns, without the corners, interpolate along column dx -/+ 1.
+		const int sideMin = std::max(dyMin, -k + 1), sideMax = std::min(dyMax, k - 1);
+		for(int dx = -k; dx <= k; dx += 2 * k)
+		{
+			if(dx < dxMin || dx > dxMax || sideMin > sideMax)
+				continue;
+			const float *inner = origin + (dx > 0 ? dx - 1 : dx + 1);
+			int cross = floorDiv(sideMin * (k - 1));
+			int remainder = sideMin * (k - 1) - cross * k;
+			for(int dy = sideMin; dy <= sideMax; dy++)
+			{
+				float z = inner[(ptrdiff_t)cross * width];
+				if(remainder > 0)
+					z += (inner[(ptrdiff_t)(cross + 1) * width] - z) * (remainder * inverseK);
+				settle(dx, dy, eye + (z - eye) * climb);
+				remainder += k - 1;
+				if(remainder >= k)
+				{
+					remainder -= k;
+					cross++;
+				}
+			}
+		}
+	}
+}
+
+void computeViewsheds(const HeightMap &map, const Observer *observers, int count, Viewshed *out)
+{
+	ThreadPool::global().parallelFor(count, 1, [&](int first, int last) {
+		for(int i = first; i < last; i++)
+			computeViewshed(map, observers[i], out[i]);
+	});
+}
@@ -0,0 +1,48 @@
+#ifndef VIEWSHED_H
+#define VIEWSHED_H
+
+#include <cstdint>
+#include <vector>
+#include "../TerrainGenerator/HeightMap.h"
+
+struct Observer
+{
+	// Map sample the observer stands on.
+	int x = 0, y = 0;
+	// Eye above the terrain, and the height above the terrain a target must
+	// reach to count as seen, both in height units.
+	float eyeHeight = 0.01f;
+	float targetHeight = 0.0f;
+	// Samples further than this (Chebyshev distance) are never visible.
+	int radius = 256;
+};
+
+// Visibility bits of the window around one observer, clipped to the map.
+// Row r starts at bit 0 of word r * wordsPerRow and covers map row y0 + r.
+struct Viewshed
+{
+	int x0 = 0, y0 = 0, width = 0, height = 0;
+	int wordsPerRow = 0;
+	std::vector<uint64_t> bits;
+
+	bool visible(int x, int y) const
+	{
+		x -= x0;
+		y -= y0;
+		if(x < 0 || y < 0 || x >= width || y >= height)
+			return false;
+		return (bits[(size_t)y * wordsPerRow + (x >> 6)] >> (x & 63)) & 1;
+	}
+	int visibleCount() const;
+};
+
+// XDraw viewshed: rings of increasing distance around the observer, each
+// sample interpolating the sight line height of the two samples of the
+// previous ring that its ray passes between. One pass costs O(r^2) with no
+// ray marching. Results can differ from exact rays by single samples near
+// the visibility boundary.
+void computeViewshed(const HeightMap &map, const Observer &observer, Viewshed &out);
+// One observer per task across the shared thread pool.
+void computeViewsheds(const HeightMap &map, const Observer *observers, int count, Viewshed *out);
+
+#endif
@@ -1,10 +1,45 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
+layout (location = 1) in float aHeight;
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+// 0: aPos holds the position. 1: aHeight holds a packed height and the grid
+// position follows from gl_VertexID. 2: as 1, but the height comes from the
+// ring of rows in `heights`, world row r in texture row r mod rows.
+uniform int vertexMode;
+// Implicit grid: vertices per row and per chunk.
+uniform int gridWidth;
+uniform int gridVertices;
+// Chunk origin in samples from the window origin.
+uniform ivec2 chunkOrigin;
+uniform float heightMin;
+uniform float heightMax;
+uniform sampler2D heights;
+uniform int firstRow;
+// Samples past this column are clipped, the last chunk column overhangs the window.
+uniform float maxColumn;
+
 void main() {
-	gl_Position = projection * view * model * vec4(aPos, 1.0);
+	vec3 position = aPos;
+	if(vertexMode != 0) {
+		// gl_VertexID includes the base vertex, which is a whole chunk.
+		int local = gl_VertexID % gridVertices;
+		ivec2 grid = ivec2(local % gridWidth, local / gridWidth);
+		position.xy = vec2(grid);
+		if(vertexMode == 1) {
+			position.z = mix(heightMin, heightMax, aHeight);
+		} else {
+			int rows = textureSize(heights, 0).y;
+			int row = (firstRow + grid.y) % rows;
+			if(row < 0)
+				row += rows;
+			position.z = texelFetch(heights, ivec2(grid.x, row), 0).r;
+		}
+	}
+	position.xy += vec2(chunkOrigin);
+	gl_ClipDistance[0] = maxColumn - position.x;
+	gl_Position = projection * view * model * vec4(position, 1.0);
 }